@@ -31,6 +31,14 @@ using namespace aup::classify;
 using namespace aup::detect;
 using namespace aup::segment;
 
+// occupancy heatmap overlay for detection input
+#define HEATMAP_OPACITY 0.35f         // opacity of the overlay, 0 disables the heatmap
+#define HEATMAP_CELL_SIZE 16          // frame pixels per accumulation grid cell
+#define HEATMAP_DECAY 0.98f           // per-frame decay of the accumulation grid
+#define HEATMAP_SATURATION 25.f       // decayed occupancy (in frames) drawn at full intensity
+#define HEATMAP_GAIN_RENORMALIZE 1e6f // fold the lazy decay gain back into the grid above this
+#define HEATMAP_REFRESH_INTERVAL 5    // frames between re-colorising the overlay
+
 class BoxVisualizerCalculator : public CalculatorBase<BoxVisualizerOptions>
 {
   unordered_map<int, Scalar> class_colors;
@@ -76,9 +84,22 @@ class BoxVisualizerCalculator : public CalculatorBase<BoxVisualizerOptions>
                                          double angle_threshold  = 90.0);
   void apply_filters(cv::Mat& frame, const std::vector<cv::Point2f>& current_landmarks,
                      const std::string& landmark_predictor_type);
+  void update_heatmap(const cv::Size& frame_size, PacketPtr<const DetectionPacket> detections);
+  void blend_heatmap(cv::Mat& frame);
   // this is to visualize the tinyYolo classes for retail demo only
   vector<string> labels;
   cv::Point text_offset;
+  // decay is applied lazily: the true grid value is heatmap_acc / heatmap_gain, so a frame only
+  // touches the cells covered by its boxes
+  bool heatmap_enabled = false;
+  Mat heatmap_acc;
+  Mat heatmap_lut;
+  Mat heatmap_overlay;
+  Mat heatmap_mask;
+  Mat heatmap_blended;
+  cv::Rect heatmap_roi; // frame pixels covered by occupied cells, the only part that is blended
+  float heatmap_gain         = 1.f;
+  uint64_t heatmap_frame_cnt = 0;
 
 protected:
   ErrorCode fill_contract(std::shared_ptr<Contract>& contract, std::string& err_str) override;
@@ -148,6 +169,21 @@ ErrorCode BoxVisualizerCalculator::initialize(std::string& err_str)
 
   text_offset = cv::Point(options->text_offset().x(), options->text_offset().y());
 
+  if (options->input_type() == BoxVisualizerOptions::INPUT_TYPE_DETECTION && HEATMAP_OPACITY > 0) {
+    if (options->render_on_nv12()) {
+      AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
+                        "\033[33moccupancy heatmap is not supported when rendering on NV12, "
+                        "ignoring it.\033[0m");
+    } else {
+      Mat ramp(1, 256, CV_8UC1);
+      for (int i = 0; i < 256; i++) {
+        ramp.at<uchar>(0, i) = (uchar)i;
+      }
+      cv::applyColorMap(ramp, heatmap_lut, cv::COLORMAP_JET);
+      heatmap_enabled = true;
+    }
+  }
+
   if (options->apply_filter_on_landmarks() == "hat") {
     // Decode the embedded landmark_filter image
     cv::Mat hat_raw_data(1, hat_png_len, CV_8UC1, hat_png);
@@ -392,6 +428,13 @@ ErrorCode BoxVisualizerCalculator::handle_detections()
 
   image_packet = const_packet_cast<ImagePacket>(image_packet_const);
 
+  // the heatmap goes under the boxes; it decays on every frame, with or without detections
+  auto frame = image_packet->get_cv_mat();
+  if (heatmap_enabled) {
+    update_heatmap(frame.size(), ret_det == ErrorCode::OK ? detections : nullptr);
+    blend_heatmap(frame);
+  }
+
   if (ret_det == ErrorCode::OK) {
 #if AUP_AVAF_PLATFORM_IS_KRIA_SOM
     if (options->render_on_nv12()) {
@@ -404,7 +447,6 @@ ErrorCode BoxVisualizerCalculator::handle_detections()
 #endif
   }
 
-  auto frame = image_packet->get_cv_mat();
   if (node->output_streams.size() == 0) {
     auto timenow           = chrono::system_clock::to_time_t(chrono::system_clock::now());
     std::string frame_name = Logger::get()->get_task_dir() + "/frame-" +
@@ -423,6 +465,77 @@ ErrorCode BoxVisualizerCalculator::handle_detections()
   return node->enqueue(0, image_packet);
 }
 
+void BoxVisualizerCalculator::update_heatmap(const cv::Size& frame_size,
+                                             PacketPtr<const DetectionPacket> detections)
+{
+  cv::Size grid_size((frame_size.width + HEATMAP_CELL_SIZE - 1) / HEATMAP_CELL_SIZE,
+                     (frame_size.height + HEATMAP_CELL_SIZE - 1) / HEATMAP_CELL_SIZE);
+  if (heatmap_acc.size() != grid_size) {
+    heatmap_acc       = Mat::zeros(grid_size, CV_32FC1);
+    heatmap_gain      = 1.f;
+    heatmap_frame_cnt = 0;
+    heatmap_overlay.release();
+  }
+
+  heatmap_gain /= HEATMAP_DECAY;
+  if (heatmap_gain > HEATMAP_GAIN_RENORMALIZE) {
+    heatmap_acc *= 1.f / heatmap_gain;
+    heatmap_gain = 1.f;
+  }
+
+  if (!detections) {
+    return;
+  }
+  cv::Rect grid_rect(0, 0, grid_size.width, grid_size.height);
+  for (auto& res : detections->detections) {
+    cv::Rect cells(res.rect.x / HEATMAP_CELL_SIZE, res.rect.y / HEATMAP_CELL_SIZE,
+                   (res.rect.width + HEATMAP_CELL_SIZE - 1) / HEATMAP_CELL_SIZE,
+                   (res.rect.height + HEATMAP_CELL_SIZE - 1) / HEATMAP_CELL_SIZE);
+    cells &= grid_rect;
+    if (cells.area() > 0) {
+      heatmap_acc(cells) += heatmap_gain;
+    }
+  }
+}
+
+void BoxVisualizerCalculator::blend_heatmap(cv::Mat& frame)
+{
+  if (heatmap_acc.empty()) {
+    return;
+  }
+
+  if (heatmap_overlay.empty() || heatmap_frame_cnt++ % HEATMAP_REFRESH_INTERVAL == 0) {
+    // a fixed scale, so the overlay fades as the grid decays; busier cells saturate at 255. Only
+    // the bounding box of the occupied cells is colorised, upscaled and later blended
+    Mat gray, gray_bgr, colorised, occupied;
+    heatmap_acc.convertTo(gray, CV_8UC1, 255.0 / (heatmap_gain * HEATMAP_SATURATION));
+    cv::findNonZero(gray, occupied);
+    if (occupied.empty()) {
+      heatmap_roi = cv::Rect();
+      return;
+    }
+    cv::Rect cells = cv::boundingRect(occupied);
+    cv::Size cells_px(cells.width * HEATMAP_CELL_SIZE, cells.height * HEATMAP_CELL_SIZE);
+    heatmap_roi = cv::Rect(cells.x * HEATMAP_CELL_SIZE, cells.y * HEATMAP_CELL_SIZE, cells_px.width,
+                           cells_px.height) &
+                  cv::Rect(0, 0, frame.cols, frame.rows);
+    cv::Rect crop(0, 0, heatmap_roi.width, heatmap_roi.height);
+    cv::cvtColor(gray(cells), gray_bgr, cv::COLOR_GRAY2BGR);
+    cv::LUT(gray_bgr, heatmap_lut, colorised);
+    cv::resize(colorised, heatmap_overlay, cells_px, 0, 0, cv::INTER_LINEAR);
+    cv::resize(gray(cells) > 0, heatmap_mask, cells_px, 0, 0, cv::INTER_NEAREST);
+    heatmap_overlay = heatmap_overlay(crop);
+    heatmap_mask    = heatmap_mask(crop);
+  }
+  if (heatmap_roi.empty()) {
+    return;
+  }
+
+  Mat roi = frame(heatmap_roi);
+  cv::addWeighted(roi, 1 - HEATMAP_OPACITY, heatmap_overlay, HEATMAP_OPACITY, 0, heatmap_blended);
+  heatmap_blended.copyTo(roi, heatmap_mask);
+}
+
 void BoxVisualizerCalculator::visualize_classifications_bgr(
   PacketPtr<ImagePacket> image_packet, PacketPtr<const Classifications> classifications)
 {
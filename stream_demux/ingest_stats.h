@@ -0,0 +1,173 @@
+#pragma once
+
+// std headers
+#include <atomic>
+#include <sstream>
+#include <stdint.h>
+#include <string>
+
+// avaf headers
+#include "aup/avaf/utils.h"
+
+#define INGEST_STATS_RATE_WINDOW_US 1000000 // bitrate and packet rate are published once per window
+#define INGEST_STATS_GAP_FRAMES 3           // a dts step over this many frame durations counts as a pts gap
+
+// link health of one ingest stream, kept so analytics drops can be matched with the network and the reconnect
+// thresholds tuned. The reader thread records packets and whichever thread reconnects records the reconnects;
+// every published value is a relaxed atomic, so any thread can take a snapshot() at runtime and the data path
+// never locks. Jitter is the RFC 3550 estimate of video packet arrival times against their dts
+class IngestStats
+{
+public:
+	struct Snapshot
+	{
+		bool connected                            = false;
+		uint64_t bytes                            = 0; // every packet of the input
+		uint64_t packets                          = 0; // video packets
+		uint64_t key_frames                       = 0;
+		double bitrate_bps                        = 0; // over the last rate window
+		double packet_rate                        = 0; // video packets per second over the last rate window
+		aup::avaf::timestamp_t jitter_us          = 0;
+		uint64_t pts_gaps                         = 0;
+		aup::avaf::timestamp_t pts_gap_max_us     = 0;
+		uint64_t reconnects                       = 0;
+		aup::avaf::timestamp_t reconnect_us       = 0; // time spent disconnected, including a reconnect in progress
+		aup::avaf::timestamp_t since_key_frame_us = -1; // -1 before the first key frame
+		aup::avaf::timestamp_t since_packet_us    = -1;
+
+		std::string str() const
+		{
+			std::ostringstream os;
+			os << (connected ? "connected" : "disconnected") << ", " << bitrate_bps / 1000 << " kbps, " << packet_rate
+			   << " pkt/s, jitter " << jitter_us << "us, " << pts_gaps << " pts gaps (max " << pts_gap_max_us
+			   << "us), " << reconnects << " reconnects (" << reconnect_us << "us), key frame " << since_key_frame_us
+			   << "us ago, packet " << since_packet_us << "us ago, " << packets << " vpackets / " << bytes
+			   << " bytes";
+			return os.str();
+		}
+	};
+
+	// reader thread, for each packet read from the input. dts and frame_duration are only used for video packets,
+	// a frame_duration of 0 disables gap detection
+	void on_packet(aup::avaf::timestamp_t now, uint32_t size, bool video, bool key_frame, aup::avaf::timestamp_t dts,
+	               aup::avaf::timestamp_t frame_duration)
+	{
+		add(bytes, size);
+		last_packet_us.store(now, std::memory_order_relaxed);
+		window_bytes += size;
+		if (video) {
+			add(packets, 1);
+			window_packets++;
+			if (key_frame) {
+				add(key_frames, 1);
+				last_key_frame_us.store(now, std::memory_order_relaxed);
+			}
+			if (prev_arrival_us != aup::avaf::timestamp_min) {
+				aup::avaf::timestamp_t step = dts - prev_dts;
+				if (frame_duration > 0 && step > frame_duration * INGEST_STATS_GAP_FRAMES) {
+					add(pts_gaps, 1);
+					if (step > pts_gap_max_us.load(std::memory_order_relaxed)) {
+						pts_gap_max_us.store(step, std::memory_order_relaxed);
+					}
+				} else if (step >= 0) {
+					aup::avaf::timestamp_t d = (now - prev_arrival_us) - step;
+					jitter += ((d < 0 ? -d : d) - jitter) / 16;
+					jitter_us.store((aup::avaf::timestamp_t)jitter, std::memory_order_relaxed);
+				}
+			}
+			prev_arrival_us = now;
+			prev_dts        = dts;
+		}
+		if (window_start_us == aup::avaf::timestamp_min) {
+			window_start_us = now;
+		} else if (now - window_start_us >= INGEST_STATS_RATE_WINDOW_US) {
+			double elapsed = now - window_start_us;
+			bitrate_bps.store(window_bytes * 8 * 1000000 / elapsed, std::memory_order_relaxed);
+			packet_rate.store(window_packets * 1000000 / elapsed, std::memory_order_relaxed);
+			window_start_us = now;
+			window_bytes    = 0;
+			window_packets  = 0;
+		}
+	}
+
+	// the input was lost, repeated calls before on_connect keep the first time
+	void on_disconnect(aup::avaf::timestamp_t now)
+	{
+		if (connected.exchange(false, std::memory_order_relaxed)) {
+			disconnected_us.store(now, std::memory_order_relaxed);
+		}
+	}
+
+	// the input was opened, counts a reconnect when it follows on_disconnect
+	void on_connect(aup::avaf::timestamp_t now)
+	{
+		aup::avaf::timestamp_t since = disconnected_us.exchange(aup::avaf::timestamp_min, std::memory_order_relaxed);
+		if (since != aup::avaf::timestamp_min) {
+			add(reconnects, 1);
+			add(reconnect_us, now - since);
+		}
+		connected.store(true, std::memory_order_relaxed);
+	}
+
+	Snapshot snapshot(aup::avaf::timestamp_t now) const
+	{
+		Snapshot s;
+		s.connected      = connected.load(std::memory_order_relaxed);
+		s.bytes          = bytes.load(std::memory_order_relaxed);
+		s.packets        = packets.load(std::memory_order_relaxed);
+		s.key_frames     = key_frames.load(std::memory_order_relaxed);
+		s.jitter_us      = jitter_us.load(std::memory_order_relaxed);
+		s.pts_gaps       = pts_gaps.load(std::memory_order_relaxed);
+		s.pts_gap_max_us = pts_gap_max_us.load(std::memory_order_relaxed);
+		s.reconnects     = reconnects.load(std::memory_order_relaxed);
+		s.reconnect_us   = reconnect_us.load(std::memory_order_relaxed);
+		aup::avaf::timestamp_t since = disconnected_us.load(std::memory_order_relaxed);
+		if (since != aup::avaf::timestamp_min) {
+			s.reconnect_us += now - since;
+		}
+		aup::avaf::timestamp_t last = last_key_frame_us.load(std::memory_order_relaxed);
+		if (last != aup::avaf::timestamp_min) {
+			s.since_key_frame_us = now - last;
+		}
+		last = last_packet_us.load(std::memory_order_relaxed);
+		if (last != aup::avaf::timestamp_min) {
+			s.since_packet_us = now - last;
+		}
+		// the rates are only refreshed by arriving packets, a silent input has none
+		if (s.since_packet_us >= 0 && s.since_packet_us < 2 * INGEST_STATS_RATE_WINDOW_US) {
+			s.bitrate_bps = bitrate_bps.load(std::memory_order_relaxed);
+			s.packet_rate = packet_rate.load(std::memory_order_relaxed);
+		}
+		return s;
+	}
+
+private:
+	// single writer, a plain load and store avoids the locked read-modify-write of fetch_add
+	template <class T, class V>
+	static void add(std::atomic<T>& counter, V v)
+	{
+		counter.store(counter.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+	}
+
+	std::atomic<bool> connected{false};
+	std::atomic<uint64_t> bytes{0};
+	std::atomic<uint64_t> packets{0};
+	std::atomic<uint64_t> key_frames{0};
+	std::atomic<double> bitrate_bps{0};
+	std::atomic<double> packet_rate{0};
+	std::atomic<aup::avaf::timestamp_t> jitter_us{0};
+	std::atomic<uint64_t> pts_gaps{0};
+	std::atomic<aup::avaf::timestamp_t> pts_gap_max_us{0};
+	std::atomic<uint64_t> reconnects{0};
+	std::atomic<aup::avaf::timestamp_t> reconnect_us{0};
+	std::atomic<aup::avaf::timestamp_t> disconnected_us{aup::avaf::timestamp_min};
+	std::atomic<aup::avaf::timestamp_t> last_key_frame_us{aup::avaf::timestamp_min};
+	std::atomic<aup::avaf::timestamp_t> last_packet_us{aup::avaf::timestamp_min};
+	// reader thread only
+	aup::avaf::timestamp_t prev_arrival_us = aup::avaf::timestamp_min;
+	aup::avaf::timestamp_t prev_dts        = 0;
+	double jitter                          = 0;
+	aup::avaf::timestamp_t window_start_us = aup::avaf::timestamp_min;
+	uint64_t window_bytes                  = 0;
+	uint64_t window_packets                = 0;
+};
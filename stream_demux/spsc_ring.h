@@ -0,0 +1,121 @@
+#pragma once
+
+// std headers
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+// bounded single producer / single consumer ring. push and pop only touch two atomic indexes; the mutex and
+// condition variables are used only while one side sleeps on a full or empty ring, so an active stream never
+// locks. The capacity is rounded up to a power of two
+template <class T>
+class SpscRing
+{
+	std::vector<T> slots;
+	uint64_t mask;
+	// the indexes sit on their own cache lines so the two threads do not bounce one line between cores
+	char pad0[64];
+	std::atomic<uint64_t> head{0}; // next slot to write, only the producer stores it
+	char pad1[64];
+	std::atomic<uint64_t> tail{0}; // next slot to read, only the consumer stores it
+	char pad2[64];
+	std::atomic<bool> consumer_waiting{false};
+	std::atomic<bool> producer_waiting{false};
+	std::mutex m;
+	std::condition_variable not_empty;
+	std::condition_variable not_full;
+
+	// the fence pairs with the one in the waiting side, so either the waiter sees the new index or we see the
+	// waiter and take the lock it holds until it sleeps
+	static void wake(std::atomic<bool>& waiting, std::mutex& m, std::condition_variable& cv)
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (waiting.load(std::memory_order_relaxed)) {
+			std::lock_guard<std::mutex> lock(m);
+			cv.notify_one();
+		}
+	}
+
+	template <class Ready>
+	static bool wait(std::atomic<bool>& waiting, std::mutex& m, std::condition_variable& cv, int64_t timeout_us,
+	                 Ready ready)
+	{
+		std::unique_lock<std::mutex> lock(m);
+		waiting.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		bool ok = cv.wait_for(lock, std::chrono::microseconds(timeout_us), ready);
+		waiting.store(false, std::memory_order_relaxed);
+		return ok;
+	}
+
+public:
+	explicit SpscRing(size_t capacity)
+	{
+		size_t sz = 1;
+		while (sz < capacity) {
+			sz <<= 1;
+		}
+		slots.resize(sz);
+		mask = sz - 1;
+	}
+
+	size_t capacity() const { return slots.size(); }
+
+	size_t size() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+
+	// running counts, an entry's sequence number is the pushed() value before it was pushed
+	uint64_t pushed() const { return head.load(std::memory_order_acquire); }
+	uint64_t popped() const { return tail.load(std::memory_order_acquire); }
+
+	// producer side, false when the ring is full
+	bool try_push(T& v)
+	{
+		uint64_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) == slots.size()) {
+			return false;
+		}
+		slots[h & mask] = std::move(v);
+		head.store(h + 1, std::memory_order_release);
+		wake(consumer_waiting, m, not_empty);
+		return true;
+	}
+
+	// producer side, waits up to timeout_us for a free slot
+	bool push(T& v, int64_t timeout_us)
+	{
+		while (!try_push(v)) {
+			if (!wait(producer_waiting, m, not_full, timeout_us, [&] { return size() < slots.size(); })) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// consumer side, false when the ring is empty
+	bool try_pop(T& v)
+	{
+		uint64_t t = tail.load(std::memory_order_relaxed);
+		if (t == head.load(std::memory_order_acquire)) {
+			return false;
+		}
+		v = std::move(slots[t & mask]);
+		slots[t & mask] = T();
+		tail.store(t + 1, std::memory_order_release);
+		wake(producer_waiting, m, not_full);
+		return true;
+	}
+
+	// consumer side, waits up to timeout_us for an entry
+	bool pop(T& v, int64_t timeout_us)
+	{
+		while (!try_pop(v)) {
+			if (!wait(consumer_waiting, m, not_empty, timeout_us, [&] { return size() > 0; })) {
+				return false;
+			}
+		}
+		return true;
+	}
+};
@@ -17,7 +17,27 @@ StreamDemuxCalculator::~StreamDemuxCalculator()
 	running_ = false;
 	AUP_AVAF_THREAD_JOIN_NOTERM(ingest_thread);
 	AUP_AVAF_THREAD_JOIN_NOTERM(worker_thread_id);
+	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+	                  __func__ << " ingest " << get_ingest_stats().str());
 	stream_close();
+	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+	                  __func__ << " " << vpacket_pool.size() << " pooled vpackets, " << vpacket_pool.get_alloc_cnt()
+	                           << " allocations (" << vpacket_pool.get_transient_cnt() << " beyond the pool), "
+	                           << vpacket_pool.get_trimmed_cnt() << " trimmed");
+	if (shed_cnt) {
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+		                  __func__ << " live backlog shed " << shed_cnt << " times, " << shed_packet_cnt
+		                           << " packets / " << shed_us << "us skipped");
+	}
+	if (pace_late_cnt || pace_resync_cnt) {
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+		                  __func__ << " file playback fell behind its pace " << pace_late_cnt << " times, "
+		                           << pace_resync_cnt << " timestamp jumps");
+	}
+	if (ring_drop_cnt) {
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+		                  __func__ << " " << ring_drop_cnt << " packets dropped on a full packet ring");
+	}
 }
 
 // index 0 is always the video packets
@@ -59,18 +79,26 @@ void StreamDemuxCalculator::packet_ingest_thread()
 		if (fmt_ctx && !b_read_eof) {
 			ret = av_read_frame(fmt_ctx, &avpkt);
 			if (ret < 0) {
-				if (AVERROR_EOF == ret) {
+				if (AVERROR(EAGAIN) == ret) {
+					usleep(1000);
+					continue;
+				} else if (AVERROR_EOF == ret) {
 					b_read_eof = true;
 					AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
 					                  __func__ << " read all packets, eof of current input stream");
-					if (!options->demux().auto_reconnect()) {
-						node->set_graph_status(GraphStatus::FINISHED);
-					}
 				} else {
 					AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_ERROR,
 					                  __func__ << " error occurs in av_read_frame");
 					continue;
 				}
+			} else {
+				bool video = avpkt.stream_index == v_stream_idx;
+				stream     = fmt_ctx->streams[avpkt.stream_index];
+				ingest_stats.on_packet(
+				    get_now_us(), avpkt.size, video, avpkt.flags == AV_PKT_FLAG_KEY,
+				    avpkt.dts != AV_NOPTS_VALUE ? av_rescale_q(avpkt.dts, stream->time_base, cq)
+				                                : (timestamp_t)v_frame_duration * read_vpck_cnt,
+				    stream_fps > 0 ? (timestamp_t)(1000000 / stream_fps) : v_frame_duration);
 			}
 
 			if (node->get_graph_status() != GraphStatus::RUNNING) {
@@ -94,6 +122,22 @@ void StreamDemuxCalculator::packet_ingest_thread()
 
 				stream = fmt_ctx->streams[v_stream_idx];
 
+				timestamp_t sample_pts = v_frame_duration * read_vpck_cnt;
+				if (avpkt.pts != AV_NOPTS_VALUE) {
+					sample_pts = av_rescale_q(avpkt.pts, stream->time_base, cq);
+				}
+				if (!in_file_range(avpkt.flags == AV_PKT_FLAG_KEY, sample_pts)) {
+					av_packet_unref(&(avpkt));
+					continue;
+				}
+				if (avpkt.pts != AV_NOPTS_VALUE) {
+					update_fps_estimate(sample_pts);
+				}
+				if (!sample_vpacket(avpkt.flags == AV_PKT_FLAG_KEY, sample_pts)) {
+					av_packet_unref(&(avpkt));
+					continue;
+				}
+
 				if (av_bfs_ctx) {
 					av_bsf_send_packet(av_bfs_ctx, &(avpkt));
 					av_bsf_receive_packet(av_bfs_ctx, &(avpkt));
@@ -106,54 +150,390 @@ void StreamDemuxCalculator::packet_ingest_thread()
 					continue;
 				}
 
-				if ((avpkt.flags == AV_PKT_FLAG_KEY && options->demux().iframe_extract()) ||
-				    !options->demux().iframe_extract()) {
-					timestamp_t pts, dts;
-					if (avpkt.pts == AV_NOPTS_VALUE) {
-						pts = dts = v_frame_duration * read_vpck_cnt;
-					} else {
-						pts = av_rescale_q(avpkt.pts, stream->time_base, cq);
-						dts = av_rescale_q(avpkt.dts, stream->time_base, cq);
-					}
-					if (last_pts == timestamp_max) {
-						sync_timestamp_offset = get_now_us();
-					} else if (pts < last_pts) {
-						sync_timestamp_offset += last_pts - pts + 1;
-					}
-					last_pts = pts;
-					bool success;
-					auto vpacket = make_packet<VideoPacket>(pts + sync_timestamp_offset, dts,
-					                                        avpkt.size + EXTRADATA_MAX_LEN, success);
-					if (!success) {
-						string er = "Issue in memory allocation.";
-						throw runtime_error(er);
-					}
-					vpacket->set_pres_timestamp(pts);
-
-					if (stream->codecpar->extradata_size > 0 && stream->codecpar->extradata_size < EXTRADATA_MAX_LEN &&
-					    avpkt.flags == AV_PKT_FLAG_KEY) {
-						memcpy(vpacket->pBuf, stream->codecpar->extradata, stream->codecpar->extradata_size);
-						memcpy(vpacket->pBuf + stream->codecpar->extradata_size, avpkt.data, avpkt.size);
-						vpacket->len = stream->codecpar->extradata_size + avpkt.size;
-					} else {
-						memcpy(vpacket->pBuf, avpkt.data, avpkt.size);
-						vpacket->len = avpkt.size;
-					}
-
-					AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
-					                  __func__ << " [" << read_vpck_cnt << "]read one vpacket");
-					m.lock();
-					read_video_packets.push_back(vpacket);
-					m.unlock();
+				timestamp_t pts, dts;
+				if (avpkt.pts == AV_NOPTS_VALUE) {
+					pts = dts = v_frame_duration * read_vpck_cnt;
+				} else {
+					pts = av_rescale_q(avpkt.pts, stream->time_base, cq);
+					dts = av_rescale_q(avpkt.dts, stream->time_base, cq);
+				}
+				if (last_pts == timestamp_max) {
+					sync_timestamp_offset = get_now_us();
+				} else if (pts < last_pts) {
+					sync_timestamp_offset += last_pts - pts + 1;
+				}
+				last_pts = pts;
+				bool success;
+				auto vpacket =
+				    vpacket_pool.acquire(pts + sync_timestamp_offset, dts, avpkt.size + EXTRADATA_MAX_LEN, success);
+				if (!success) {
+					string er = "Issue in memory allocation.";
+					throw runtime_error(er);
+				}
+				vpacket->set_pres_timestamp(pts);
+				vpacket->picType = (avpkt.flags == AV_PKT_FLAG_KEY) ? PicType::I : PicType::NONE;
+
+				if (stream->codecpar->extradata_size > 0 && stream->codecpar->extradata_size < EXTRADATA_MAX_LEN &&
+				    avpkt.flags == AV_PKT_FLAG_KEY) {
+					memcpy(vpacket->pBuf, stream->codecpar->extradata, stream->codecpar->extradata_size);
+					memcpy(vpacket->pBuf + stream->codecpar->extradata_size, avpkt.data, avpkt.size);
+					vpacket->len = stream->codecpar->extradata_size + avpkt.size;
+				} else {
+					memcpy(vpacket->pBuf, avpkt.data, avpkt.size);
+					vpacket->len = avpkt.size;
 				}
+
+				AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+				                  __func__ << " [" << read_vpck_cnt << "]read one vpacket");
+				push_vpacket(vpacket, avpkt.flags == AV_PKT_FLAG_KEY);
 			}
 			av_packet_unref(&avpkt);
+		} else {
+			usleep(1000);
 		}
+	}
+}
 
-		usleep(1000);
+// hands a packet to the worker thread. A full ring blocks, unless a live stream opted into overflow=drop: then the
+// packet is dropped and so are the following ones up to the next key frame, so the decoder never sees a broken
+// reference chain
+void StreamDemuxCalculator::push_vpacket(PacketPtr<VideoPacket>& vpacket, bool key_frame)
+{
+	uint64_t seq    = read_video_packets.pushed();
+	timestamp_t sts = vpacket->get_sync_timestamp();
+	if (ring_overflow_policy == DEMUX_RING_OVERFLOW_BLOCK || get_url_type(input_url) != UrlType::LIVE_STREAM) {
+		while (running_ && !read_video_packets.push(vpacket, DEMUX_RING_WAIT_US)) {
+		}
+		if (read_video_packets.pushed() == seq) {
+			return;
+		}
+	} else {
+		if (ring_wait_key_frame && !key_frame) {
+			ring_drop_cnt++;
+			return;
+		}
+		ring_wait_key_frame = !read_video_packets.try_push(vpacket);
+		if (ring_wait_key_frame) {
+			ring_drop_cnt++;
+			AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
+			                  __func__ << " packet ring full, dropping packets up to the next key frame, pts:"
+			                           << vpacket->get_pres_timestamp());
+			return;
+		}
+	}
+	last_ingest_sts = sts;
+	if (key_frame) {
+		newest_key_seq.store(seq + 1, memory_order_release);
 	}
 }
 
+// live inputs only: when the packets queued behind the one just popped span more than latency_budget_us,
+// the backlog up to the newest queued key frame is discarded and vpacket becomes that key frame, so the decoder
+// resumes on a clean reference instead of falling further behind
+void StreamDemuxCalculator::shed_backlog(PacketPtr<VideoPacket>& vpacket)
+{
+	timestamp_t span = last_ingest_sts - vpacket->get_sync_timestamp();
+	uint64_t key_seq = newest_key_seq.load(memory_order_acquire);
+	if (span <= latency_budget_us || !key_seq || key_seq - 1 < read_video_packets.popped()) {
+		return;
+	}
+	timestamp_t first_pts = vpacket->get_pres_timestamp();
+	uint32_t skipped      = 1;
+	while (read_video_packets.popped() < key_seq - 1 && read_video_packets.try_pop(vpacket)) {
+		skipped++;
+	}
+	if (!read_video_packets.try_pop(vpacket)) {
+		return;
+	}
+	timestamp_t skipped_us = std::max(vpacket->get_pres_timestamp() - first_pts, (timestamp_t)0);
+	shed_cnt++;
+	shed_packet_cnt += skipped;
+	shed_us += skipped_us;
+	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
+	                  __func__ << " live backlog of " << span << "us over the " << latency_budget_us
+	                           << "us budget, skipped " << skipped << " packets (" << skipped_us
+	                           << "us) to the key frame at pts " << vpacket->get_pres_timestamp());
+	// the sender's wall clock (RTCP sender reports) dates the frame's capture
+	if (fmt_ctx && fmt_ctx->start_time_realtime != AV_NOPTS_VALUE && fmt_ctx->start_time_realtime > 0) {
+		timestamp_t start_us   = fmt_ctx->start_time != AV_NOPTS_VALUE ? fmt_ctx->start_time : 0;
+		timestamp_t capture_us = fmt_ctx->start_time_realtime + vpacket->get_pres_timestamp() - start_us;
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
+		                  __func__ << " glass-to-demux latency " << av_gettime() - capture_us << "us");
+	}
+}
+
+// the input url takes a media fragment of '&' separated keys. File inputs select what to demux and how fast:
+//   t=30,90         seconds from the start of the file, either bound may be left out
+//   shard=2/8       the third of 8 equal parts, cannot be combined with t=
+//   pace=2x         playback speed by dts, pace=realtime is 1x and pace=max is unthrottled
+// live inputs choose what a full packet ring and a growing backlog do:
+//   overflow=drop   drop up to the next key frame instead of blocking the ingest, overflow=block is the default
+//   latency_budget=500ms
+//                   skip to the newest queued key frame once the backlog spans more, in ms or s, 0 turns it off
+// and any input picks the packets it forwards, overriding iframe_extract:
+//   sample=key_nth:5
+//                   all, key (every key frame), key_nth:N (every N-th key frame), key_interval:S (the first key
+//                   frame S seconds or more after the last one sent) or gop_head:N (each key frame and the N
+//                   frames decoded after it); the number may be left out for its DEMUX_SAMPLE_* default
+// e.g. "video.mp4#shard=2/8&pace=max" or "rtsp://cam/stream#overflow=drop". The fragment is removed from input_url
+bool StreamDemuxCalculator::parse_url_fragment(string& err_str)
+{
+	size_t pos = input_url.rfind('#');
+	if (pos == string::npos) {
+		return true;
+	}
+	string fragment = input_url.substr(pos + 1);
+	double start_s = -1, end_s = -1;
+	int k = -1, n = -1;
+	float speed    = pace_speed;
+	int overflow   = ring_overflow_policy;
+	double budget  = latency_budget_us / 1e6;
+	int sample     = sample_mode;
+	double arg     = -1;
+	bool file_keys = false;
+	bool live_keys = false;
+	for (size_t key_pos = 0; key_pos <= fragment.size();) {
+		size_t key_end = std::min(fragment.find('&', key_pos), fragment.size());
+		string key     = fragment.substr(key_pos, key_end - key_pos);
+		key_pos        = key_end + 1;
+		file_keys |= !key.compare(0, 2, "t=") || !key.compare(0, 6, "shard=") || !key.compare(0, 5, "pace=");
+		live_keys |= !key.compare(0, 9, "overflow=") || !key.compare(0, 15, "latency_budget=");
+		if (!key.compare(0, 2, "t=")) {
+			string range = key.substr(2);
+			size_t comma = range.find(',');
+			string start = range.substr(0, comma);
+			string end   = comma == string::npos ? "" : range.substr(comma + 1);
+			char* rest   = NULL;
+			if (start.size() && ((start_s = strtod(start.c_str(), &rest)) < 0 || *rest)) {
+				err_str = "invalid start in " + key;
+				return false;
+			}
+			if (end.size() && ((end_s = strtod(end.c_str(), &rest)) <= std::max(start_s, 0.) || *rest)) {
+				err_str = "invalid end in " + key;
+				return false;
+			}
+		} else if (!key.compare(0, 6, "shard=")) {
+			if (sscanf(key.c_str() + 6, "%d/%d", &k, &n) != 2 || n < 1 || k < 0 || k >= n) {
+				err_str = "invalid shard in " + key + ", expected shard=k/n with 0 <= k < n";
+				return false;
+			}
+		} else if (!key.compare(0, 5, "pace=")) {
+			string pace = key.substr(5);
+			char* rest  = NULL;
+			if (pace == "max") {
+				speed = 0;
+			} else if (pace == "realtime") {
+				speed = 1;
+			} else if ((speed = strtof(pace.c_str(), &rest)) <= 0 || strcmp(rest, "x")) {
+				err_str = "invalid pace in " + key + ", expected max, realtime or a speed like 2x";
+				return false;
+			}
+		} else if (!key.compare(0, 9, "overflow=")) {
+			if (key != "overflow=block" && key != "overflow=drop") {
+				err_str = "invalid overflow in " + key + ", expected block or drop";
+				return false;
+			}
+			overflow = key == "overflow=drop" ? DEMUX_RING_OVERFLOW_DROP : DEMUX_RING_OVERFLOW_BLOCK;
+		} else if (!key.compare(0, 15, "latency_budget=")) {
+			char* rest = NULL;
+			budget     = strtod(key.c_str() + 15, &rest);
+			if (key.size() == 15 || budget < 0 || (strcmp(rest, "s") && strcmp(rest, "ms") && (budget || *rest))) {
+				err_str = "invalid latency budget in " + key + ", expected a duration like 500ms or 2s, or 0";
+				return false;
+			}
+			budget /= strcmp(rest, "ms") ? 1 : 1000;
+		} else if (!key.compare(0, 7, "sample=")) {
+			size_t colon = key.find(':');
+			string mode  = key.substr(7, colon == string::npos ? string::npos : colon - 7);
+			char* rest   = NULL;
+			arg          = colon == string::npos ? -1 : strtod(key.c_str() + colon + 1, &rest);
+			sample       = mode == "all"            ? DEMUX_SAMPLE_ALL
+			               : mode == "key"          ? DEMUX_SAMPLE_KEY
+			               : mode == "key_nth"      ? DEMUX_SAMPLE_KEY_NTH
+			               : mode == "key_interval" ? DEMUX_SAMPLE_KEY_INTERVAL
+			               : mode == "gop_head"     ? DEMUX_SAMPLE_GOP_HEAD
+			                                        : -1;
+			bool valid   = sample >= 0 && colon == string::npos;
+			if (colon != string::npos && sample >= DEMUX_SAMPLE_KEY_NTH && colon + 1 < key.size() && !*rest) {
+				// key_nth counts from 1, gop_head from 0, the interval is any positive number of seconds
+				valid = sample == DEMUX_SAMPLE_KEY_INTERVAL
+				            ? arg > 0
+				            : arg == floor(arg) && arg >= (sample == DEMUX_SAMPLE_KEY_NTH) && arg <= UINT32_MAX;
+			}
+			if (!valid) {
+				err_str = "invalid sample in " + key + ", expected all, key, key_nth:N, key_interval:S or gop_head:N";
+				return false;
+			}
+		} else if (key_pos == key.size() + 1) {
+			return true; // not ours, part of the url
+		} else {
+			err_str = "unknown key " + key + " in " + fragment;
+			return false;
+		}
+	}
+	if (n > 0 && (start_s >= 0 || end_s >= 0)) {
+		err_str = "a shard cannot be combined with a time range in " + fragment;
+		return false;
+	}
+	input_url = input_url.substr(0, pos);
+	if (file_keys && get_url_type(input_url) != UrlType::NATIVE_VIDEO) {
+		err_str = "time ranges, shards and pacing need a file input";
+		return false;
+	}
+	if (live_keys && get_url_type(input_url) != UrlType::LIVE_STREAM) {
+		err_str = "ring overflow policies and latency budgets need a live input";
+		return false;
+	}
+	range_start_s        = start_s;
+	range_end_s          = end_s;
+	shard_k              = k;
+	shard_n              = n;
+	pace_speed           = speed;
+	ring_overflow_policy = overflow;
+	latency_budget_us    = (timestamp_t)(budget * 1e6);
+	sample_mode          = sample;
+	if (arg >= 0 && sample == DEMUX_SAMPLE_KEY_NTH) {
+		sample_key_step = (uint32_t)arg;
+	} else if (arg >= 0 && sample == DEMUX_SAMPLE_KEY_INTERVAL) {
+		sample_interval_us = (timestamp_t)(arg * 1e6);
+	} else if (arg >= 0 && sample == DEMUX_SAMPLE_GOP_HEAD) {
+		sample_gop_head_frames = (uint32_t)arg;
+	}
+	return true;
+}
+
+// turns the parsed range into stream timestamps once the file is open, and seeks to the key frame it starts on. A
+// time range starts on the last key frame at or before its start; the seek index is not trusted to find it, a
+// seek that lands on an earlier key frame would emit whole extra GOPs, so it is looked up by reading and the
+// packets before it are dropped. A failed seek fails the open rather than demux the file from the beginning
+bool StreamDemuxCalculator::seek_file_range(string& err_str)
+{
+	timestamp_t start_time = fmt_ctx->start_time != AV_NOPTS_VALUE ? fmt_ctx->start_time : 0;
+	if (shard_n > 0) {
+		if (fmt_ctx->duration == AV_NOPTS_VALUE || fmt_ctx->duration <= 0) {
+			err_str = "file duration unknown, cannot shard " + input_url;
+			return false;
+		}
+		// both bounds use the first key frame at or after them, so consecutive shards meet on the same key frame
+		range_start_us = shard_k ? start_time + fmt_ctx->duration * shard_k / shard_n : timestamp_min;
+		range_end_us =
+		    shard_k + 1 < shard_n ? start_time + fmt_ctx->duration * (shard_k + 1) / shard_n : timestamp_max;
+	} else if (range_start_s >= 0 || range_end_s >= 0) {
+		range_start_us = range_start_s > 0 ? start_time + (timestamp_t)(range_start_s * 1000000) : timestamp_min;
+		range_end_us   = range_end_s > 0 ? start_time + (timestamp_t)(range_end_s * 1000000) : timestamp_max;
+	} else {
+		return true;
+	}
+	range_started = false;
+	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+	                  __func__ << " demuxing " << input_url << " from " << range_start_us << " to " << range_end_us
+	                           << "us" << (shard_n > 0 ? ", shard " : "")
+	                           << (shard_n > 0 ? to_string(shard_k) + "/" + to_string(shard_n) : ""));
+	range_key_us = range_start_us;
+	if (range_start_us == timestamp_min) {
+		return true;
+	}
+	AVStream* stream = fmt_ctx->streams[v_stream_idx];
+	int64_t start    = av_rescale_q(range_start_us, AV_TIME_BASE_Q, stream->time_base);
+	if (av_seek_frame(fmt_ctx, v_stream_idx, start, AVSEEK_FLAG_BACKWARD) < 0) {
+		err_str = "seek to " + to_string(range_start_us) + "us in " + input_url + " failed";
+		return false;
+	}
+	if (shard_n > 0) {
+		return true;
+	}
+	int64_t key_pts = find_range_start_key(start);
+	if (key_pts == AV_NOPTS_VALUE) {
+		err_str = "no key frame around " + to_string(range_start_us) + "us in " + input_url;
+		return false;
+	}
+	range_key_us = av_rescale_q(key_pts, stream->time_base, AV_TIME_BASE_Q);
+	if (av_seek_frame(fmt_ctx, v_stream_idx, key_pts, AVSEEK_FLAG_BACKWARD) < 0) {
+		err_str = "seek to the key frame at " + to_string(range_key_us) + "us in " + input_url + " failed";
+		return false;
+	}
+	return true;
+}
+
+// reads on from the seek point and returns the pts (stream time base) of the last video key frame at or before
+// start, or of the first one after it when the file has none before; AV_NOPTS_VALUE when there is no key frame
+int64_t StreamDemuxCalculator::find_range_start_key(int64_t start)
+{
+	AVPacket avpkt  = {0};
+	int64_t key_pts = AV_NOPTS_VALUE;
+	while (av_read_frame(fmt_ctx, &avpkt) >= 0) {
+		bool key =
+		    avpkt.stream_index == v_stream_idx && avpkt.flags == AV_PKT_FLAG_KEY && avpkt.pts != AV_NOPTS_VALUE;
+		int64_t pts = avpkt.pts;
+		av_packet_unref(&avpkt);
+		if (!key) {
+			continue;
+		}
+		if (pts <= start || key_pts == AV_NOPTS_VALUE) {
+			key_pts = pts;
+		}
+		if (pts > start) {
+			break;
+		}
+	}
+	return key_pts;
+}
+
+// gates file packets, in decode order, to the configured range. Output starts on a key frame and stops before the
+// first key frame at or after the end, so every packet sent decodes and consecutive shards neither repeat nor miss
+// a frame
+bool StreamDemuxCalculator::in_file_range(bool key_frame, timestamp_t pts)
+{
+	if (!range_started) {
+		if (!key_frame || pts < range_key_us) {
+			return false;
+		}
+		range_started = true;
+		if (pts < range_start_us) {
+			// a decoder needs the whole GOP, and a VideoPacket cannot be flagged decode only
+			AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+			                  __func__ << " range starts on the key frame at " << pts << "us, "
+			                           << range_start_us - pts << "us of pre-roll before the requested start");
+		}
+	}
+	if (key_frame && pts >= range_end_us && !b_read_eof) {
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+		                  __func__ << " range ends before the key frame at " << pts << "us");
+		b_read_eof = true;
+	}
+	return !b_read_eof;
+}
+
+// holds a file packet until its dts is due on a playback clock started by the first packet. Deadlines are taken
+// from the clock anchor rather than from the previous packet, so sleep overshoot does not accumulate into drift.
+// The clock is re-anchored when the timestamps jump or when downstream held us back for longer than
+// DEMUX_PACE_RESYNC_US, so playback resumes at speed instead of bursting to catch up
+void StreamDemuxCalculator::pace_vpacket(const PacketPtr<VideoPacket>& vpacket)
+{
+	timestamp_t dts = vpacket->dts;
+	timestamp_t now = get_now_us();
+	if (pace_anchor_us == timestamp_max || dts < pace_last_dts ||
+	    dts - pace_last_dts > DEMUX_PACE_RESYNC_US * pace_speed) {
+		pace_resync_cnt += pace_anchor_us != timestamp_max;
+		pace_anchor_us  = now;
+		pace_anchor_dts = dts;
+	}
+	pace_last_dts   = dts;
+	timestamp_t due = pace_anchor_us + (timestamp_t)((dts - pace_anchor_dts) / pace_speed);
+	if (now - due > DEMUX_PACE_RESYNC_US) {
+		pace_late_cnt++;
+		pace_anchor_us  = now;
+		pace_anchor_dts = dts;
+		return;
+	}
+	while (running_ && (now = get_now_us()) < due) {
+		usleep(std::min(due - now, (timestamp_t)DEMUX_RING_WAIT_US));
+	}
+}
+
+// link health of the input, safe to call from any thread while the node runs
+IngestStats::Snapshot StreamDemuxCalculator::get_ingest_stats() const { return ingest_stats.snapshot(get_now_us()); }
+
 void StreamDemuxCalculator::worker_thread()
 {
 	AUP_AVAF_HANDLE_THREAD_NAME();
@@ -165,19 +545,31 @@ void StreamDemuxCalculator::worker_thread()
 			continue;
 		}
 
-		m.lock();
-		if (read_video_packets.size() > 0) {
+		// read before the pop: once eof is seen every packet was pushed, so an empty pop means all are out
+		bool read_eof = b_read_eof;
+		PacketPtr<VideoPacket> vpacket;
+		if (read_video_packets.pop(vpacket, DEMUX_RING_WAIT_US)) {
+			if (latency_budget_us && get_url_type(input_url) == UrlType::LIVE_STREAM) {
+				shed_backlog(vpacket);
+			} else if (pace_speed > 0 && get_url_type(input_url) == UrlType::NATIVE_VIDEO) {
+				pace_vpacket(vpacket);
+			}
 			ErrorCode ec;
-			if ((ec = node->enqueue(0, read_video_packets.at(0))) != ErrorCode::OK) {
+			if ((ec = node->enqueue(0, vpacket)) != ErrorCode::OK) {
 				AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_ERROR,
-				                  __func__ << " vpacket(pts:" << read_video_packets[0]->get_pres_timestamp()
-				                           << ") enqueue to " << node->output_streams[0].first
-				                           << " failed. Error code:" << ec);
+				                  __func__ << " vpacket(pts:" << vpacket->get_pres_timestamp() << ") enqueue to "
+				                           << node->output_streams[0].first << " failed. Error code:" << ec);
 			}
-			// std::cout <<"XXXX enqueue video_packet:" << *read_video_packets[0].get() << std::endl;
-			read_video_packets.erase(read_video_packets.begin());
+		} else if (read_eof && !options->demux().auto_reconnect()) {
+			node->set_graph_status(GraphStatus::FINISHED);
+			continue;
+		}
+
+		if (get_now_us() - last_stats_log_us > DEMUX_STATS_LOG_INTERVAL_US) {
+			last_stats_log_us = get_now_us();
+			AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+			                  __func__ << " ingest " << get_ingest_stats().str());
 		}
-		m.unlock();
 
 		if (get_url_type(input_url) == UrlType::LIVE_STREAM) {
 			if (fmt_ctx) {
@@ -191,15 +583,15 @@ void StreamDemuxCalculator::worker_thread()
 				     last_io_cruise_timestamp) > IO_NETWORK_CRUISE_INTERVAL) {
 					if (v_stream_idx >= 0 && options->demux().auto_reconnect() && !io_read_force_interrupt &&
 					    (read_vpck_cnt_period <
-					     (vid_stream_info_packet->fps / 8.0) *
+					     (stream_fps / 8.0) *
 					         ((duration_cast<microseconds>(system_clock::now().time_since_epoch()).count() -
 					           last_io_cruise_timestamp) /
 					          1000000))) {
 						io_read_force_interrupt = true;
 						AUP_AVAF_LOG_NODE(
 						    node, GraphConfig::LoggingFilter::SEVERITY_WARN,
-						    __func__
-						        << " input stream packet lost too much, force input stream interrupt and reconnect");
+						    __func__ << " input stream packet lost too much, force input stream interrupt and reconnect"
+						             << ". Ingest " << get_ingest_stats().str());
 					}
 					read_vpck_cnt_period = 0;
 					last_io_cruise_timestamp =
@@ -230,8 +622,6 @@ void StreamDemuxCalculator::worker_thread()
 				}
 			}
 		}
-
-		usleep(1000);
 	}
 }
 
@@ -248,104 +638,168 @@ static int ff_interrupt_cb(void* opaque)
 	return 0;
 }
 
-float StreamDemuxCalculator::get_authentic_fps()
+// the container's rate, the starting point of the measured one
+float StreamDemuxCalculator::get_declared_fps()
 {
 	float dst_fps = 15;
 	if (fmt_ctx && v_stream_idx < (int32_t)fmt_ctx->nb_streams) {
 		AVStream* pStream = fmt_ctx->streams[v_stream_idx];
-		if (NULL == pStream) {
-			return dst_fps;
-		}
 		if (pStream->avg_frame_rate.num > 0 && pStream->avg_frame_rate.den > 0) {
 			dst_fps = (float)pStream->avg_frame_rate.num / (float)pStream->avg_frame_rate.den;
 		} else if (pStream->r_frame_rate.num > 0 && pStream->r_frame_rate.den > 0) {
 			dst_fps = (float)pStream->r_frame_rate.num / (float)pStream->r_frame_rate.den;
-		} else {
-			pStream->avg_frame_rate.num = 15;
-			pStream->avg_frame_rate.den = 1;
 		}
-		dst_fps = std::min((float)FF_MAX_SUPPORT_FPS, dst_fps);
-
-		int ret                 = -1;
-		uint32_t vid_packet_cnt = 0;
-		uint64_t read_start     = duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
-		uint64_t first_vid_pts  = UINT64_MAX;
-		std::list<int64_t> vid_pts_list;
-		AVPacket avpkt = {0};
-		AVRational cq  = {1, AV_TIME_BASE};
-		while (1) {
-			ret = av_read_frame(fmt_ctx, &avpkt);
-			if (!ret && avpkt.stream_index == v_stream_idx) {
-				if (avpkt.pts != AV_NOPTS_VALUE) {
-					vid_pts_list.push_back(av_rescale_q(avpkt.pts, pStream->time_base, cq));
-					if (first_vid_pts == UINT64_MAX) {
-						first_vid_pts = avpkt.pts;
-					}
-				} else {
-					AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
-					                  __func__ << " [" << vid_packet_cnt << "]current read pts is AV_NOPTS_VALUE");
-				}
-				vid_packet_cnt++;
-			}
-			av_packet_unref(&avpkt);
+	}
+	return std::min((float)FF_MAX_SUPPORT_FPS, dst_fps);
+}
 
-			if (vid_packet_cnt > 60 || (duration_cast<microseconds>(system_clock::now().time_since_epoch()).count() -
-			                            read_start) > 3000000) // max read vpkt is 60,max reading time is 3s
-			{
-				if (vid_pts_list.size() > 3) {
-					vid_pts_list.sort(); // sort pts(avoid pts disorder if stream has B frame)
-					std::list<int64_t>::iterator iter;
-					std::list<int64_t>::iterator iter_;
-					std::list<int64_t> intervalList;
-					for (iter = vid_pts_list.begin(), iter_ = ++(vid_pts_list.begin()); iter_ != vid_pts_list.end();) {
-						intervalList.push_back((int64_t)fabs(*iter - *iter_));
-						iter++;
-						iter_++;
-					}
-					intervalList.sort();
-
-					int64_t last_pts_interval = INT64_MAX;
-					std::list<std::pair<int64_t, uint32_t>> interval_cnt_map_list;
-					for (iter = intervalList.begin(); iter != intervalList.end(); iter++) {
-						if ((*iter) != last_pts_interval) {
-							interval_cnt_map_list.push_back(std::make_pair((*iter), 1));
-						} else {
-							interval_cnt_map_list.back().second++;
-						}
-						last_pts_interval = (*iter);
-					}
+// rate of the median interval between the pts in fps_pts_window, 0 with fewer than min_deltas intervals. The median
+// ignores the odd gap of a lost packet or a timestamp jump. Consumes the window
+float StreamDemuxCalculator::median_fps(size_t min_deltas)
+{
+	std::sort(fps_pts_window.begin(), fps_pts_window.end()); // avoid pts disorder if stream has B frame
+	fps_pts_deltas.clear();
+	for (size_t i = 1; i < fps_pts_window.size(); i++) {
+		if (fps_pts_window[i] > fps_pts_window[i - 1]) {
+			fps_pts_deltas.push_back(fps_pts_window[i] - fps_pts_window[i - 1]);
+		}
+	}
+	fps_pts_window.clear();
+	if (fps_pts_deltas.size() < std::max(min_deltas, (size_t)1)) {
+		return 0;
+	}
+	auto mid = fps_pts_deltas.begin() + fps_pts_deltas.size() / 2;
+	std::nth_element(fps_pts_deltas.begin(), mid, fps_pts_deltas.end());
+	return std::min((float)1000000 / (float)*mid, (float)FF_MAX_SUPPORT_FPS);
+}
 
-					auto most_map = *std::max_element(interval_cnt_map_list.begin(), interval_cnt_map_list.end(),
-					                                  [](const auto& a, const auto& b) { return a.second < b.second; });
-
-					float auth_fps = std::min((float)1000000 / (float)most_map.first, (float)FF_MAX_SUPPORT_FPS);
-					AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
-					                  __func__ << " video pts list size:" << vid_pts_list.size()
-					                           << ", readFps:" << dst_fps << ", authentic FPS:" << auth_fps
-					                           << ", occurrences:" << most_map.second);
-					if (fabsf(auth_fps - dst_fps) > dst_fps * 0.1) {
-						AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
-						                  __func__ << " correct fps from " << dst_fps << " to " << auth_fps);
-						dst_fps = auth_fps;
-					}
+// measures the rate before the stream info is published, for inputs whose container rate cannot be trusted. Reads
+// up to DEMUX_FPS_WINDOW video packets for at most DEMUX_FPS_PROBE_US and also takes the GOP length when two key
+// frames were seen. A file is seeked back to where the probe started, a live input just loses the packets
+float StreamDemuxCalculator::probe_fps()
+{
+	AVStream* stream     = fmt_ctx->streams[v_stream_idx];
+	AVPacket avpkt       = {0};
+	AVRational cq        = {1, AV_TIME_BASE};
+	int64_t first_pts    = AV_NOPTS_VALUE;
+	int32_t last_key_idx = -1;
+	uint32_t vpacket_cnt = 0;
+	uint64_t probe_start = get_now_us();
+	fps_pts_window.clear();
+	while (vpacket_cnt < DEMUX_FPS_WINDOW && get_now_us() - probe_start < DEMUX_FPS_PROBE_US) {
+		int ret = av_read_frame(fmt_ctx, &avpkt);
+		if (AVERROR(EAGAIN) == ret) {
+			usleep(1000);
+			continue;
+		} else if (ret < 0) {
+			break;
+		}
+		if (avpkt.stream_index == v_stream_idx) {
+			if (avpkt.pts != AV_NOPTS_VALUE) {
+				if (first_pts == AV_NOPTS_VALUE) {
+					first_pts = avpkt.pts;
 				}
-				break;
+				fps_pts_window.push_back(av_rescale_q(avpkt.pts, stream->time_base, cq));
+			}
+			if (avpkt.flags == AV_PKT_FLAG_KEY) {
+				if (last_key_idx >= 0) {
+					gop_len_avg = (float)(vpacket_cnt - last_key_idx);
+				}
+				last_key_idx = vpacket_cnt;
 			}
+			vpacket_cnt++;
 		}
+		av_packet_unref(&avpkt);
+	}
+	float fps = median_fps(3);
+	if (get_url_type(input_url) == UrlType::NATIVE_VIDEO) {
+		int ret = first_pts != AV_NOPTS_VALUE
+		              ? av_seek_frame(fmt_ctx, v_stream_idx, first_pts, AVSEEK_FLAG_FRAME | AVSEEK_FLAG_BACKWARD)
+		              : avformat_seek_file(fmt_ctx, v_stream_idx, INT64_MIN, 0, INT64_MAX, AVSEEK_FLAG_BYTE);
+		if (ret < 0) {
+			AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
+			                  __func__ << " file " << input_url << " seek back to the beginning failed");
+		}
+	}
+	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+	                  __func__ << " " << vpacket_cnt << " vpackets read, fps:" << fps << ", gop:" << gop_len_avg);
+	return fps;
+}
 
-		if (get_url_type(input_url) == UrlType::NATIVE_VIDEO) {
-			if (first_vid_pts != UINT64_MAX) {
-				ret = av_seek_frame(fmt_ctx, v_stream_idx, first_vid_pts, AVSEEK_FLAG_FRAME | AVSEEK_FLAG_BACKWARD);
-			} else {
-				ret = avformat_seek_file(fmt_ctx, v_stream_idx, INT64_MIN, 0, INT64_MAX, AVSEEK_FLAG_BYTE);
+// keeps the source rate right for the reconnect check and the synthesized timestamps as packets are ingested. The
+// published stream info is not updated: decoders read it once, when they initialize
+void StreamDemuxCalculator::update_fps_estimate(timestamp_t pts)
+{
+	if (options->demux().force_fps() > 0) {
+		return;
+	}
+	fps_pts_window.push_back(pts);
+	if (fps_pts_window.size() < DEMUX_FPS_WINDOW) {
+		return;
+	}
+	float est_fps = median_fps(DEMUX_FPS_WINDOW / 2);
+	if (!est_fps || fabsf(est_fps - stream_fps) <= stream_fps * DEMUX_FPS_CORRECT_RATIO) {
+		return;
+	}
+	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
+	                  __func__ << " correct fps from " << stream_fps << " to " << est_fps);
+	stream_fps       = est_fps;
+	v_frame_duration = (int32_t)roundf((float)1000000 / est_fps);
+}
+
+// decides, before the packet is filtered, copied or allocated, whether it is forwarded under the sampling mode
+bool StreamDemuxCalculator::sample_vpacket(bool key_frame, timestamp_t pts)
+{
+	switch (sample_mode) {
+		case DEMUX_SAMPLE_KEY:
+			return key_frame;
+		case DEMUX_SAMPLE_KEY_NTH:
+			return key_frame && sample_key_cnt++ % sample_key_step == 0;
+		case DEMUX_SAMPLE_KEY_INTERVAL:
+			// a pts going backwards (loop, reconnect) restarts the interval
+			if (!key_frame || (last_sample_pts != timestamp_min && pts >= last_sample_pts &&
+			                   pts - last_sample_pts < sample_interval_us)) {
+				return false;
 			}
-			if (ret < 0) {
-				AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
-				                  __func__ << " file " << input_url << " seek back to the beginning failed");
+			last_sample_pts = pts;
+			return true;
+		case DEMUX_SAMPLE_GOP_HEAD:
+			// the frames decoded right after a key frame only reference frames already sent
+			if (key_frame) {
+				gop_head_left = sample_gop_head_frames + 1;
 			}
+			if (!gop_head_left) {
+				return false;
+			}
+			gop_head_left--;
+			return true;
+		default:
+			return true;
+	}
+}
+
+// the rate packets leave at under the sampling mode, the source rate when the GOP length is not known
+float StreamDemuxCalculator::sampled_fps()
+{
+	float fps = stream_fps;
+	if (sample_mode == DEMUX_SAMPLE_ALL || gop_len_avg < 1) {
+		return fps;
+	}
+	float gop_fps = fps / gop_len_avg;
+	switch (sample_mode) {
+		case DEMUX_SAMPLE_KEY:
+			return gop_fps;
+		case DEMUX_SAMPLE_KEY_NTH:
+			return gop_fps / sample_key_step;
+		case DEMUX_SAMPLE_KEY_INTERVAL: {
+			float gop_us = 1000000 / gop_fps;
+			return 1000000 / (std::max(1.f, ceilf(sample_interval_us / gop_us)) * gop_us);
 		}
+		case DEMUX_SAMPLE_GOP_HEAD:
+			return fps * std::min((float)sample_gop_head_frames + 1, gop_len_avg) / gop_len_avg;
+		default:
+			return fps;
 	}
-	return dst_fps;
 }
 
 ErrorCode StreamDemuxCalculator::initialize(string& err_str)
@@ -370,13 +824,35 @@ ErrorCode StreamDemuxCalculator::initialize(string& err_str)
 		err_str = "Cannot get input url";
 		return ErrorCode::ERROR;
 	}
+	sample_mode = options->demux().iframe_extract() ? DEMUX_SAMPLE_MODE_IFRAME_EXTRACT : DEMUX_SAMPLE_ALL;
+	if (!parse_url_fragment(err_str)) {
+		return ErrorCode::ERROR;
+	}
+	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+	                  "        sample_mode = " << sample_mode << ", key step " << sample_key_step << ", interval "
+	                                           << sample_interval_us << "us, gop head " << sample_gop_head_frames);
+	if (get_url_type(input_url) == UrlType::NATIVE_VIDEO) {
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+		                  "        pace_speed = " << pace_speed << (pace_speed > 0 ? "x" : " (unthrottled)"));
+	} else if (get_url_type(input_url) == UrlType::LIVE_STREAM) {
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+		                  "        ring_overflow = "
+		                      << (ring_overflow_policy == DEMUX_RING_OVERFLOW_DROP ? "drop" : "block"));
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+		                  "        latency_budget = " << latency_budget_us << "us"
+		                                              << (latency_budget_us ? "" : " (off)"));
+	}
 	vid_stream_info_packet = make_packet<VideoStreamInfoPacket>();
 
 	if (!stream_open()) {
 		err_str = "issue opennig stream";
 		return ErrorCode::ERROR;
 	}
-	vid_stream_info_packet->iframe_extract = options->demux().iframe_extract();
+	if (!seek_file_range(err_str)) {
+		return ErrorCode::ERROR;
+	}
+	// a GOP head burst is not key frames only, the decoder keeps its references across it
+	vid_stream_info_packet->iframe_extract = sample_mode != DEMUX_SAMPLE_ALL && sample_mode != DEMUX_SAMPLE_GOP_HEAD;
 
 	if (node->output_streams.size() > 1) {
 		auto ec = node->enqueue(1, vid_stream_info_packet);
@@ -428,6 +904,7 @@ bool StreamDemuxCalculator::stream_open()
 		return false;
 	}
 
+	bool fps_declared = true;
 	for (int i = 0; i < (int32_t)fmt_ctx->nb_streams; i++) {
 		stream = fmt_ctx->streams[i];
 		if (stream->codecpar->codec_id == AV_CODEC_ID_NONE) {
@@ -440,6 +917,7 @@ bool StreamDemuxCalculator::stream_open()
 				} else {
 					stream->avg_frame_rate.num = 25;
 					stream->avg_frame_rate.den = 1;
+					fps_declared               = false;
 				}
 			}
 
@@ -452,8 +930,23 @@ bool StreamDemuxCalculator::stream_open()
 		stream                    = fmt_ctx->streams[v_stream_idx];
 		vid_stream_info_packet->w = stream->codecpar->width;
 		vid_stream_info_packet->h = stream->codecpar->height;
-		vid_stream_info_packet->fps =
-		    (options->demux().force_fps() > 0) ? options->demux().force_fps() : get_authentic_fps();
+		if (options->demux().force_fps() > 0) {
+			stream_fps = options->demux().force_fps();
+		} else if (!stream_fps) {
+			// the stream info goes out once, so a live rate or a missing one is measured before it is published;
+			// a reconnect keeps the rate already measured
+			stream_fps = get_declared_fps();
+			if (get_url_type(input_url) == UrlType::LIVE_STREAM || !fps_declared) {
+				float probed_fps = probe_fps();
+				if (probed_fps && fabsf(probed_fps - stream_fps) > stream_fps * DEMUX_FPS_CORRECT_RATIO) {
+					AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
+					                  __func__ << " correct fps from " << stream_fps << " to " << probed_fps);
+					stream_fps = probed_fps;
+				}
+			}
+		}
+		vid_stream_info_packet->fps = sampled_fps();
+		fps_pts_window.clear();
 		// TODO Update approach to avoid using depricated function
 #if !AUP_AVAF_PLATFORM_IS_U30_HOST
 #pragma GCC diagnostic push
@@ -461,7 +954,7 @@ bool StreamDemuxCalculator::stream_open()
 		vid_stream_info_packet->max_bframes = stream->codec->has_b_frames;
 #pragma GCC diagnostic pop
 #endif
-		v_frame_duration = (int32_t)roundf((float)1000000 / vid_stream_info_packet->fps);
+		v_frame_duration = (int32_t)roundf((float)1000000 / stream_fps);
 
 		switch (stream->codecpar->codec_id) {
 			case AV_CODEC_ID_H264:
@@ -499,11 +992,13 @@ bool StreamDemuxCalculator::stream_open()
 
 	is_av_io_open = 1;
 	av_dump_format(fmt_ctx, 0, input_url.c_str(), 0);
+	ingest_stats.on_connect(get_now_us());
 	return true;
 }
 
 void StreamDemuxCalculator::stream_close()
 {
+	ingest_stats.on_disconnect(get_now_us());
 	if (fmt_ctx) {
 		avformat_close_input(&fmt_ctx);
 		fmt_ctx = NULL;
@@ -3,6 +3,7 @@
 #include "aup/avaf/config.h"
 
 // std headers
+#include <atomic>
 #include <semaphore.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -43,6 +44,11 @@ extern "C"
 #include "aup/avaf/utils.h"
 #include "aup/avap/stream_mux.pb.h"
 
+// local headers
+#include "ingest_stats.h"
+#include "spsc_ring.h"
+#include "video_packet_pool.h"
+
 using namespace std;
 using namespace aup::avaf;
 
@@ -51,6 +57,28 @@ using namespace aup::avaf;
 #define FF_MAX_SUPPORT_FPS 90
 #define EXTRADATA_MAX_LEN 256
 #define IO_NETWORK_CRUISE_INTERVAL 10000000
+#define DEMUX_RING_SIZE 256          // packets buffered between the ingest and worker threads
+#define DEMUX_RING_WAIT_US 10000     // longest sleep on an empty/full ring before the threads recheck their state
+#define DEMUX_RING_OVERFLOW_BLOCK 0  // ingest waits for room
+#define DEMUX_RING_OVERFLOW_DROP 1   // the new packet is dropped and so is everything up to the next key frame
+#define DEMUX_RING_OVERFLOW_POLICY_DEFAULT DEMUX_RING_OVERFLOW_BLOCK // overflow=drop url key, files always block
+#define DEMUX_FPS_WINDOW 60          // video packets per frame rate estimate
+#define DEMUX_FPS_CORRECT_RATIO 0.1 // measured change that corrects the source frame rate
+#define DEMUX_FPS_PROBE_US 3000000   // longest read at open measuring the rate of a live input
+#define DEMUX_PACKET_POOL_SIZE 512   // recycled VideoPackets, covers the ring plus the packets held downstream
+#define DEMUX_SAMPLE_ALL 0           // every packet
+#define DEMUX_SAMPLE_KEY 1           // every key frame
+#define DEMUX_SAMPLE_KEY_NTH 2       // every sample_key_step-th key frame
+#define DEMUX_SAMPLE_KEY_INTERVAL 3  // the first key frame sample_interval_us or more after the last one sent
+#define DEMUX_SAMPLE_GOP_HEAD 4      // each key frame and the sample_gop_head_frames frames decoded after it
+#define DEMUX_SAMPLE_MODE_IFRAME_EXTRACT DEMUX_SAMPLE_KEY // mode selected by iframe_extract without a sample= url key
+#define DEMUX_SAMPLE_KEY_STEP 5           // sample=key_nth without a step
+#define DEMUX_SAMPLE_INTERVAL_US 5000000 // sample=key_interval without an interval
+#define DEMUX_SAMPLE_GOP_HEAD_FRAMES 4   // sample=gop_head without a frame count
+#define DEMUX_LIVE_LATENCY_BUDGET_US 0 // live backlog shedding without a latency_budget= url key, 0 off
+#define DEMUX_PACE_SPEED_DEFAULT 0 // file playback speed without a pace= url key, 0 reads as fast as downstream takes
+#define DEMUX_PACE_RESYNC_US 500000 // lateness or dts jump that re-anchors the file playback clock
+#define DEMUX_STATS_LOG_INTERVAL_US 60000000 // period of the ingest statistics log
 
 class StreamDemuxCalculator : public CalculatorBase<StreamMuxOptions>
 {
@@ -67,7 +95,20 @@ public:
 	ErrorCode initialize(string& err_str) override;
 	bool stream_open();
 	void stream_close();
-	float get_authentic_fps();
+	float get_declared_fps();
+	float median_fps(size_t min_deltas);
+	float probe_fps();
+	void update_fps_estimate(timestamp_t pts);
+	bool sample_vpacket(bool key_frame, timestamp_t pts);
+	float sampled_fps();
+	void push_vpacket(PacketPtr<VideoPacket>& vpacket, bool key_frame);
+	void shed_backlog(PacketPtr<VideoPacket>& vpacket);
+	bool parse_url_fragment(string& err_str);
+	bool seek_file_range(string& err_str);
+	int64_t find_range_start_key(int64_t start);
+	bool in_file_range(bool key_frame, timestamp_t pts);
+	void pace_vpacket(const PacketPtr<VideoPacket>& vpacket);
+	IngestStats::Snapshot get_ingest_stats() const;
 	thread worker_thread_id;
 	thread ingest_thread;
 	bool running_ = false;
@@ -75,10 +116,50 @@ public:
 	mutex m;
 	uint32_t read_vpck_cnt        = 0;
 	uint32_t read_vpck_cnt_period = 0;
-	vector<PacketPtr<VideoPacket>> read_video_packets;
+	SpscRing<PacketPtr<VideoPacket>> read_video_packets{DEMUX_RING_SIZE};
+	int ring_overflow_policy = DEMUX_RING_OVERFLOW_POLICY_DEFAULT;
+	bool ring_wait_key_frame = false; // a packet was dropped on overflow, drop until the next key frame
+	uint64_t ring_drop_cnt   = 0;
+	// live backlog shedding: the ingest thread publishes, the worker sheds
+	timestamp_t latency_budget_us = DEMUX_LIVE_LATENCY_BUDGET_US; // queued span that skips to the newest key frame
+	atomic<uint64_t> newest_key_seq{0}; // ring sequence number + 1 of the newest queued key frame, 0 for none
+	atomic<timestamp_t> last_ingest_sts{0};
+	uint64_t shed_cnt        = 0;
+	uint64_t shed_packet_cnt = 0;
+	timestamp_t shed_us      = 0;
+	// file time range or shard, from the input url fragment
+	double range_start_s       = -1;
+	double range_end_s         = -1;
+	int shard_k                = -1;
+	int shard_n                = -1;
+	timestamp_t range_start_us = timestamp_min;
+	timestamp_t range_end_us   = timestamp_max;
+	timestamp_t range_key_us   = timestamp_min; // the range starts on the first key frame at or after this
+	bool range_started         = true;
+	IngestStats ingest_stats;
+	timestamp_t last_stats_log_us = 0;
+	// file playback pacing, worker thread only
+	float pace_speed            = DEMUX_PACE_SPEED_DEFAULT; // 1 is realtime, 0 unthrottled
+	timestamp_t pace_anchor_us  = timestamp_max;            // wall clock of the packet the clock started on
+	timestamp_t pace_anchor_dts = 0;
+	timestamp_t pace_last_dts   = 0;
+	uint64_t pace_late_cnt      = 0;
+	uint64_t pace_resync_cnt    = 0;
+	VideoPacketPool vpacket_pool{DEMUX_PACKET_POOL_SIZE};
+	vector<timestamp_t> fps_pts_window; // ingest thread only
+	vector<timestamp_t> fps_pts_deltas;
+	atomic<float> stream_fps{0}; // source frame rate, the published one is the sampled rate
+	int sample_mode                 = DEMUX_SAMPLE_ALL;
+	uint32_t sample_key_step        = DEMUX_SAMPLE_KEY_STEP;
+	timestamp_t sample_interval_us  = DEMUX_SAMPLE_INTERVAL_US;
+	uint32_t sample_gop_head_frames = DEMUX_SAMPLE_GOP_HEAD_FRAMES;
+	float gop_len_avg               = 0; // measured by probe_fps, 0 when unknown
+	uint32_t sample_key_cnt         = 0;
+	timestamp_t last_sample_pts     = timestamp_min;
+	uint32_t gop_head_left          = 0;
 	string input_url;
 	AVFormatContext* fmt_ctx                      = NULL;
-	bool b_read_eof                               = false;
+	atomic<bool> b_read_eof{false};
 	bool got_1st_key_frame                        = false;
 	int32_t v_stream_idx                          = -1;
 	uint32_t v_frame_duration                     = 0;
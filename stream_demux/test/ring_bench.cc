@@ -0,0 +1,132 @@
+// std headers
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// local headers
+#include "../spsc_ring.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// stands in for a VideoPacket: a shared, heap allocated payload stamped with its ingest time
+struct BenchPacket
+{
+	int64_t ingest_us = 0;
+	vector<uint8_t> payload;
+};
+using BenchPacketPtr = shared_ptr<BenchPacket>;
+
+static int64_t now_us() { return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count(); }
+
+static void report(const char* name, vector<int64_t>& latencies, uint64_t sent, int64_t elapsed_us)
+{
+	sort(latencies.begin(), latencies.end());
+	double avg = 0;
+	for (auto l : latencies) {
+		avg += l;
+	}
+	avg = latencies.empty() ? 0 : avg / latencies.size();
+	cout << left << setw(8) << name << " delivered:" << latencies.size() << "/" << sent << " pkt_per_s:" << fixed
+	     << setprecision(0) << latencies.size() * 1e6 / elapsed_us << " latency_avg_us:" << avg
+	     << " latency_p99_us:" << (latencies.empty() ? 0 : latencies[latencies.size() * 99 / 100])
+	     << " latency_max_us:" << (latencies.empty() ? 0 : latencies.back()) << endl;
+}
+
+// sends count packets at rate packets per second (0 for as fast as possible) through push, while a consumer
+// thread drains them with pop, then prints the throughput and the ingest to consumer latency
+template <class Push, class Pop>
+static void run(const char* name, uint64_t count, int rate, size_t payload, Push push, Pop pop)
+{
+	vector<int64_t> latencies;
+	latencies.reserve(count);
+	atomic<bool> done{false};
+	int64_t start = now_us();
+	thread consumer([&] {
+		BenchPacketPtr pkt;
+		while (latencies.size() < count) {
+			if (pop(pkt)) {
+				latencies.push_back(now_us() - pkt->ingest_us);
+				pkt.reset();
+			} else if (done) {
+				break;
+			}
+		}
+	});
+	for (uint64_t i = 0; i < count; i++) {
+		if (rate) {
+			int64_t due = start + (int64_t)(i * 1e6 / rate);
+			while (now_us() < due) {
+				this_thread::yield();
+			}
+		}
+		auto pkt       = make_shared<BenchPacket>();
+		pkt->ingest_us = now_us();
+		pkt->payload.resize(payload);
+		push(pkt);
+	}
+	done = true;
+	consumer.join();
+	report(name, latencies, count, now_us() - start);
+}
+
+// the former stream_demux hand-off: a vector under a mutex, erase(begin()) per packet and a 1 ms sleep in both
+// loops
+static void run_vector(uint64_t count, int rate, size_t payload)
+{
+	mutex m;
+	vector<BenchPacketPtr> packets;
+	run(
+	    "vector", count, rate, payload,
+	    [&](BenchPacketPtr& pkt) {
+		    m.lock();
+		    packets.push_back(pkt);
+		    m.unlock();
+		    usleep(1000);
+	    },
+	    [&](BenchPacketPtr& pkt) {
+		    bool got = false;
+		    m.lock();
+		    if (packets.size() > 0) {
+			    pkt = packets.at(0);
+			    packets.erase(packets.begin());
+			    got = true;
+		    }
+		    m.unlock();
+		    usleep(1000);
+		    return got;
+	    });
+}
+
+static void run_ring(uint64_t count, int rate, size_t payload, size_t capacity)
+{
+	SpscRing<BenchPacketPtr> ring(capacity);
+	run(
+	    "ring", count, rate, payload,
+	    [&](BenchPacketPtr& pkt) {
+		    while (!ring.push(pkt, 10000)) {
+		    }
+	    },
+	    [&](BenchPacketPtr& pkt) { return ring.pop(pkt, 10000); });
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t count  = argc > 1 ? stoull(argv[1]) : 5000;
+	int rate        = argc > 2 ? stoi(argv[2]) : 0;
+	size_t payload  = argc > 3 ? stoul(argv[3]) : 16384;
+	size_t capacity = argc > 4 ? stoul(argv[4]) : 256;
+	cout << "packets:" << count << " rate:" << (rate ? to_string(rate) + "/s" : string("unthrottled"))
+	     << " payload:" << payload << " ring:" << capacity << endl;
+	run_vector(count, rate, payload);
+	run_ring(count, rate, payload, capacity);
+	return 0;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+// std headers
+#include <algorithm>
+#include <vector>
+
+// avaf headers
+#include "aup/avaf/packets/video_packet.h"
+#include "aup/avaf/utils.h"
+
+#define VIDEO_PACKET_POOL_LARGE_SIZE (256 * 1024) // access units above this (key frames) use their own size class
+#define VIDEO_PACKET_POOL_LARGE_ENTRIES 8         // pooled packets of the large size class
+#define VIDEO_PACKET_POOL_TRIM_INTERVAL 1024      // acquires between two trims of idle or oversized packets
+
+// recycles the VideoPackets handed downstream: a packet is reused once the pool holds its only reference, so a
+// steady stream allocates nothing after warm up. Buffers are sized with headroom and only regrown when a larger
+// access unit arrives; when every pooled packet is still in flight a transient one is allocated instead of waiting.
+// Key frames come from a small separate size class, so one large IDR does not grow every pooled buffer, and every
+// VIDEO_PACKET_POOL_TRIM_INTERVAL acquires the idle packets that went unused or are sized for more than twice the
+// largest recent access unit are released, so a burst or a bitrate drop does not pin memory for the stream's life
+class VideoPacketPool
+{
+	struct Entry
+	{
+		aup::avaf::PacketPtr<aup::avaf::VideoPacket> packet;
+		uint32_t capacity  = 0;
+		uint64_t last_used = 0; // acquire_cnt when last handed out
+	};
+	struct SizeClass
+	{
+		std::vector<Entry> entries;
+		size_t max_size = 0;
+		size_t next     = 0;
+		uint32_t peak   = 0; // largest access unit since the last trim
+	};
+	SizeClass regular;
+	SizeClass large;
+	uint64_t acquire_cnt   = 0;
+	uint64_t alloc_cnt     = 0;
+	uint64_t transient_cnt = 0;
+	uint64_t trimmed_cnt   = 0;
+
+	static uint32_t padded(uint32_t size) { return (size + size / 4 + 0xffff) & ~0xffff; }
+
+	// releases the idle packets not handed out since `since` and those far larger than the recent peak; packets
+	// still held downstream are kept
+	void trim(SizeClass& c, uint64_t since)
+	{
+		uint64_t limit = 2 * (uint64_t)padded(c.peak);
+		auto unneeded  = [&](const Entry& entry) {
+			return entry.packet.use_count() <= 1 && (entry.last_used < since || entry.capacity > limit);
+		};
+		auto keep = std::remove_if(c.entries.begin(), c.entries.end(), unneeded);
+		trimmed_cnt += c.entries.end() - keep;
+		c.entries.erase(keep, c.entries.end());
+		c.next = 0;
+		c.peak = 0;
+	}
+
+public:
+	explicit VideoPacketPool(size_t max_size)
+	{
+		regular.max_size = max_size;
+		large.max_size   = std::min(max_size, (size_t)VIDEO_PACKET_POOL_LARGE_ENTRIES);
+		regular.entries.reserve(regular.max_size);
+		large.entries.reserve(large.max_size);
+	}
+
+	aup::avaf::PacketPtr<aup::avaf::VideoPacket> acquire(aup::avaf::timestamp_t sts, aup::avaf::timestamp_t dts,
+	                                                      uint32_t size, bool& success)
+	{
+		if (++acquire_cnt % VIDEO_PACKET_POOL_TRIM_INTERVAL == 0) {
+			trim(regular, acquire_cnt - VIDEO_PACKET_POOL_TRIM_INTERVAL);
+			trim(large, acquire_cnt - VIDEO_PACKET_POOL_TRIM_INTERVAL);
+		}
+		SizeClass& c = size > VIDEO_PACKET_POOL_LARGE_SIZE ? large : regular;
+		c.peak       = std::max(c.peak, size);
+		Entry* grow  = NULL;
+		for (size_t i = 0; i < c.entries.size(); i++) {
+			Entry& entry = c.entries[(c.next + i) % c.entries.size()];
+			if (entry.packet.use_count() > 1) {
+				continue;
+			}
+			if (entry.capacity >= size) {
+				c.next          = (c.next + i + 1) % c.entries.size();
+				entry.last_used = acquire_cnt;
+				entry.packet->set_sync_timestamp(sts);
+				entry.packet->dts     = dts;
+				entry.packet->len     = 0;
+				entry.packet->picType = aup::avaf::PicType::NONE;
+				success               = true;
+				return entry.packet;
+			}
+			if (!grow) {
+				grow = &entry;
+			}
+		}
+		if (!grow && c.entries.size() < c.max_size) {
+			c.entries.emplace_back();
+			grow = &c.entries.back();
+		}
+		alloc_cnt++;
+		if (!grow) {
+			transient_cnt++;
+			return aup::avaf::make_packet<aup::avaf::VideoPacket>(sts, dts, size, success);
+		}
+		grow->capacity  = padded(size);
+		grow->last_used = acquire_cnt;
+		grow->packet    = aup::avaf::make_packet<aup::avaf::VideoPacket>(sts, dts, grow->capacity, success);
+		if (!success) {
+			grow->packet   = nullptr;
+			grow->capacity = 0;
+			return nullptr;
+		}
+		return grow->packet;
+	}
+
+	size_t size() const { return regular.entries.size() + large.entries.size(); }
+	uint64_t get_alloc_cnt() const { return alloc_cnt; }
+	uint64_t get_transient_cnt() const { return transient_cnt; }
+	uint64_t get_trimmed_cnt() const { return trimmed_cnt; }
+};
@@ -0,0 +1,524 @@
+// declaration header
+#include "stream_demux_pool.h"
+
+// std headres
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+
+// framework headers
+#include "aup/avaf/thread_name.h"
+
+using namespace std::chrono;
+
+static uint64_t now_us() { return duration_cast<microseconds>(system_clock::now().time_since_epoch()).count(); }
+
+DemuxPoolStream::~DemuxPoolStream()
+{
+	if (fmt_ctx) {
+		avformat_close_input(&fmt_ctx);
+	}
+	if (av_bsf_ctx) {
+		av_bsf_free(&av_bsf_ctx);
+	}
+}
+
+StreamDemuxPoolCalculator::~StreamDemuxPoolCalculator()
+{
+	{
+		lock_guard<mutex> lock(m);
+		running_ = false;
+	}
+	stopping.notify_all();
+	for (auto& dispatcher : dispatchers) {
+		dispatcher->wake();
+		AUP_AVAF_THREAD_JOIN_NOTERM(dispatcher->thread_id);
+	}
+	for (auto& stream : streams) {
+		AUP_AVAF_THREAD_JOIN_NOTERM(stream->reader_thread_id);
+	}
+	for (auto& stream : streams) {
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+		                  __func__ << " stream " << stream->idx << " read " << stream->read_vpck_cnt
+		                           << " vpackets, dropped " << stream->drop_cnt << ", output paused "
+		                           << stream->output_pause_cnt << " times, reconnected " << stream->reconnect_cnt
+		                           << " times, " << stream->vpacket_pool.get_alloc_cnt()
+		                           << " vpacket allocations (" << stream->vpacket_pool.get_trimmed_cnt()
+		                           << " trimmed). Ingest " << get_ingest_stats(stream->idx).str());
+		stream_close(*stream);
+	}
+}
+
+// outputs: N video packet streams followed by their N video stream info side packets, one per url of input_url
+ErrorCode StreamDemuxPoolCalculator::fill_contract(shared_ptr<Contract>& contract, string& err_str)
+{
+	if (contract->input_stream_names.size() != 0) {
+		err_str = "node does not have any inputs";
+		return ErrorCode::INVALID_CONTRACT;
+	}
+	auto sz = contract->output_stream_names.size();
+	if (sz < 2 || sz % 2 != 0) {
+		err_str = "node must have a video output and a stream info output per input url";
+		return ErrorCode::INVALID_CONTRACT;
+	}
+	auto video_packet             = make_packet<VideoPacket>();
+	auto video_stream_info_packet = make_packet<VideoStreamInfoPacket>();
+	for (int i = 0; i < (int)sz / 2; i++) {
+		contract->sample_output_packets[i]          = video_packet;
+		contract->sample_output_packets[i + sz / 2] = video_stream_info_packet;
+	}
+	return ErrorCode::OK;
+}
+
+static int ff_interrupt_cb(void* opaque)
+{
+	DemuxPoolStream* stream = (DemuxPoolStream*)opaque;
+
+	if (stream->io_read_force_interrupt || !*stream->running ||
+	    (!stream->is_av_io_open && (now_us() - stream->io_open_start_ts) > FF_AVFORMATCTX_OPEN_WAIT)) {
+		return -1;
+	}
+
+	return 0;
+}
+
+bool StreamDemuxPoolCalculator::stream_open(DemuxPoolStream& stream)
+{
+	stream.fmt_ctx = avformat_alloc_context();
+	if (NULL == stream.fmt_ctx) {
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_ERROR,
+		                  __func__ << " avformat_alloc_context failed");
+		return false;
+	}
+
+	stream.io_open_start_ts                     = now_us();
+	stream.is_av_io_open                        = false;
+	stream.io_read_force_interrupt              = false;
+	stream.fmt_ctx->interrupt_callback.callback = ff_interrupt_cb;
+	stream.fmt_ctx->interrupt_callback.opaque   = &stream;
+
+	AVDictionary* avOpts = NULL;
+	if (!strncmp(stream.url.c_str(), "rtsp://", strlen("rtsp://")) && options->demux().rtsp_transport() == "tcp") {
+		av_dict_set(&avOpts, "rtsp_transport", "tcp", 0);
+	}
+	int ret = avformat_open_input(&stream.fmt_ctx, stream.url.c_str(), NULL, &avOpts);
+	av_dict_free(&avOpts);
+	if (ret) {
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_ERROR,
+		                  __func__ << " stream " << stream.idx << " can not probe input url:" << stream.url);
+		avformat_free_context(stream.fmt_ctx);
+		stream.fmt_ctx = NULL;
+		return false;
+	}
+	if (avformat_find_stream_info(stream.fmt_ctx, NULL) < 0) {
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_ERROR,
+		                  __func__ << " stream " << stream.idx << " find stream info failed:" << stream.url);
+		return false;
+	}
+
+	stream.v_stream_idx = av_find_best_stream(stream.fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+	if (stream.v_stream_idx < 0) {
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_ERROR,
+		                  __func__ << " stream " << stream.idx << " no available video stream found");
+		return false;
+	}
+	AVStream* avstream = stream.fmt_ctx->streams[stream.v_stream_idx];
+	float fps          = 25;
+	if (options->demux().force_fps() > 0) {
+		fps = options->demux().force_fps();
+	} else if (avstream->avg_frame_rate.num > 0 && avstream->avg_frame_rate.den > 0) {
+		fps = (float)avstream->avg_frame_rate.num / (float)avstream->avg_frame_rate.den;
+	} else if (avstream->r_frame_rate.num > 0 && avstream->r_frame_rate.den > 0) {
+		fps = (float)avstream->r_frame_rate.num / (float)avstream->r_frame_rate.den;
+	}
+	fps                     = std::min((float)FF_MAX_SUPPORT_FPS, fps);
+	stream.v_frame_duration = (int32_t)roundf((float)1000000 / fps);
+
+	// the stream info is published once; a reconnect keeps it, downstream nodes are sized for it
+	if (!stream.vid_stream_info_packet) {
+		auto& info           = stream.vid_stream_info_packet;
+		info                 = make_packet<VideoStreamInfoPacket>();
+		info->w              = avstream->codecpar->width;
+		info->h              = avstream->codecpar->height;
+		info->fps            = fps;
+		info->iframe_extract = options->demux().iframe_extract();
+#if !AUP_AVAF_PLATFORM_IS_U30_HOST
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+		info->max_bframes = avstream->codec->has_b_frames;
+#pragma GCC diagnostic pop
+#endif
+		info->codec_type = avstream->codecpar->codec_id == AV_CODEC_ID_HEVC ? CODEC_TYPE_H265 : CODEC_TYPE_H264;
+	}
+
+	const AVBitStreamFilter* av_bit_stream_filter = NULL;
+	switch (avstream->codecpar->codec_id) {
+		case AV_CODEC_ID_H264:
+			av_bit_stream_filter = av_bsf_get_by_name("h264_mp4toannexb");
+			break;
+		case AV_CODEC_ID_HEVC:
+			av_bit_stream_filter = av_bsf_get_by_name("hevc_mp4toannexb");
+			break;
+		default:
+			AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_ERROR,
+			                  __func__ << " stream " << stream.idx << " is not h264 or h265");
+			return false;
+	}
+	if (av_bsf_alloc(av_bit_stream_filter, &stream.av_bsf_ctx)) {
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_ERROR, __func__ << " av bsf alloc failed");
+		return false;
+	}
+	avcodec_parameters_copy(stream.av_bsf_ctx->par_in, avstream->codecpar);
+	av_bsf_init(stream.av_bsf_ctx);
+
+	stream.got_1st_key_frame = false;
+	stream.is_av_io_open     = true;
+	stream.stats.on_connect(now_us());
+	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+	                  __func__ << " stream " << stream.idx << " " << stream.url << ": "
+	                           << avcodec_get_name(avstream->codecpar->codec_id) << " " << avstream->codecpar->width
+	                           << "x" << avstream->codecpar->height << "@" << fps);
+	return true;
+}
+
+void StreamDemuxPoolCalculator::stream_close(DemuxPoolStream& stream)
+{
+	stream.is_av_io_open = false;
+	stream.stats.on_disconnect(now_us());
+	if (stream.fmt_ctx) {
+		avformat_close_input(&stream.fmt_ctx);
+		stream.fmt_ctx = NULL;
+	}
+	if (stream.av_bsf_ctx) {
+		av_bsf_free(&stream.av_bsf_ctx);
+		stream.av_bsf_ctx = NULL;
+	}
+}
+
+// reads one packet of the stream and hands its video packets to the dispatcher, false once the input ended or
+// failed
+bool StreamDemuxPoolCalculator::read_vpacket(DemuxPoolStream& stream)
+{
+	AVPacket avpkt = {0};
+	AVRational cq  = {1, AV_TIME_BASE};
+	int ret        = av_read_frame(stream.fmt_ctx, &avpkt);
+	if (AVERROR(EAGAIN) == ret) {
+		usleep(1000);
+		return true;
+	} else if (ret < 0) {
+		return false;
+	}
+	AVStream* avstream = stream.fmt_ctx->streams[avpkt.stream_index];
+	bool video         = avpkt.stream_index == stream.v_stream_idx;
+	stream.stats.on_packet(now_us(), avpkt.size, video, avpkt.flags == AV_PKT_FLAG_KEY,
+	                       avpkt.dts != AV_NOPTS_VALUE ? av_rescale_q(avpkt.dts, avstream->time_base, cq)
+	                                                   : (timestamp_t)stream.v_frame_duration * stream.read_vpck_cnt,
+	                       stream.v_frame_duration);
+	// drop packets when graph is not running, live inputs keep reading to stay fresh
+	if (!video || !avpkt.size ||
+	    node->get_graph_status() != GraphStatus::RUNNING ||
+	    (avpkt.flags != AV_PKT_FLAG_KEY && !stream.got_1st_key_frame)) {
+		av_packet_unref(&avpkt);
+		return true;
+	}
+	stream.got_1st_key_frame = true;
+	stream.read_vpck_cnt++;
+	stream.read_vpck_cnt_period++;
+
+	av_bsf_send_packet(stream.av_bsf_ctx, &avpkt);
+	av_bsf_receive_packet(stream.av_bsf_ctx, &avpkt);
+	bool key_frame = avpkt.flags == AV_PKT_FLAG_KEY;
+	if (!avpkt.size || (options->demux().iframe_extract() && !key_frame)) {
+		av_packet_unref(&avpkt);
+		return true;
+	}
+
+	avstream = stream.fmt_ctx->streams[stream.v_stream_idx];
+	timestamp_t pts, dts;
+	if (avpkt.pts == AV_NOPTS_VALUE) {
+		pts = dts = stream.v_frame_duration * stream.read_vpck_cnt;
+	} else {
+		pts = av_rescale_q(avpkt.pts, avstream->time_base, cq);
+		dts = av_rescale_q(avpkt.dts, avstream->time_base, cq);
+	}
+	if (stream.last_pts == timestamp_max) {
+		stream.sync_timestamp_offset = get_now_us();
+	} else if (pts < stream.last_pts) {
+		stream.sync_timestamp_offset += stream.last_pts - pts + 1;
+	}
+	stream.last_pts = pts;
+
+	bool success;
+	auto vpacket =
+	    stream.vpacket_pool.acquire(pts + stream.sync_timestamp_offset, dts, avpkt.size + EXTRADATA_MAX_LEN, success);
+	if (!success) {
+		string er = "Issue in memory allocation.";
+		throw runtime_error(er);
+	}
+	vpacket->set_pres_timestamp(pts);
+	vpacket->picType = key_frame ? PicType::I : PicType::NONE;
+	if (avstream->codecpar->extradata_size > 0 && avstream->codecpar->extradata_size < EXTRADATA_MAX_LEN && key_frame) {
+		memcpy(vpacket->pBuf, avstream->codecpar->extradata, avstream->codecpar->extradata_size);
+		memcpy(vpacket->pBuf + avstream->codecpar->extradata_size, avpkt.data, avpkt.size);
+		vpacket->len = avstream->codecpar->extradata_size + avpkt.size;
+	} else {
+		memcpy(vpacket->pBuf, avpkt.data, avpkt.size);
+		vpacket->len = avpkt.size;
+	}
+	av_packet_unref(&avpkt);
+	push_vpacket(stream, vpacket, key_frame);
+	return true;
+}
+
+// a full ring blocks a file reader; a live reader drops up to the next key frame so the socket keeps draining
+void StreamDemuxPoolCalculator::push_vpacket(DemuxPoolStream& stream, PacketPtr<VideoPacket>& vpacket,
+                                             bool key_frame)
+{
+	if (!stream.live) {
+		while (running_ && !stream.ring.push(vpacket, DEMUX_POOL_WAIT_US)) {
+		}
+		if (vpacket) {
+			return;
+		}
+	} else {
+		if (stream.ring_wait_key_frame && !key_frame) {
+			stream.drop_cnt++;
+			return;
+		}
+		stream.ring_wait_key_frame = !stream.ring.try_push(vpacket);
+		if (stream.ring_wait_key_frame) {
+			stream.drop_cnt++;
+			AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
+			                  __func__ << " stream " << stream.idx
+			                           << " packet ring full, dropping packets up to the next key frame");
+			return;
+		}
+	}
+	stream.dispatcher->wake();
+}
+
+// one per input url. The thread sleeps inside av_read_frame until its socket has data and reconnects its own
+// stream, so a dead camera never holds up the others
+void StreamDemuxPoolCalculator::reader_thread(DemuxPoolStream* stream)
+{
+	AUP_AVAF_HANDLE_THREAD_NAME();
+	uint32_t reconnect_cont_failed_no = 0;
+	while (running_) {
+		if (node->get_graph_status() != GraphStatus::RUNNING && !stream->live) {
+			usleep(10000);
+			continue;
+		}
+		if (stream->fmt_ctx && read_vpacket(*stream)) {
+			continue;
+		}
+		if (!stream->live || !options->demux().auto_reconnect()) {
+			AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
+			                  __func__ << " stream " << stream->idx << " read all packets, eof of " << stream->url);
+			stream->finished = true;
+			return;
+		}
+		stream_close(*stream);
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
+		                  __func__ << " ready to reconnect input stream " << stream->url);
+		if (stream_open(*stream)) {
+			AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
+			                  __func__ << " reconnect input stream " << stream->url << " done");
+			reconnect_cont_failed_no = 0;
+			stream->reconnect_cnt++;
+			continue;
+		}
+		stream_close(*stream);
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_ERROR,
+		                  __func__ << " reconnect input stream " << stream->url << " failed");
+		uint32_t sleep_ms =
+		    std::min(5 + (++reconnect_cont_failed_no / 5) * 5, (uint32_t)DEMUX_POOL_RECONNECT_MAX_MS / 1000) * 1000;
+		unique_lock<mutex> lock(m);
+		stopping.wait_for(lock, milliseconds(sleep_ms), [&] { return !running_; });
+	}
+}
+
+// flags a live stream that delivered less than an eighth of its frame rate over the last cruise interval; the
+// interrupt callback then fails its read and the reader reconnects
+void StreamDemuxPoolCalculator::check_stalled_stream(DemuxPoolStream& stream)
+{
+	uint32_t cnt = stream.read_vpck_cnt_period.exchange(0);
+	if (stream.live && stream.is_av_io_open && !stream.io_read_force_interrupt &&
+	    cnt < (stream.vid_stream_info_packet->fps / 8.0) * (IO_NETWORK_CRUISE_INTERVAL / 1000000)) {
+		stream.io_read_force_interrupt = true;
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
+		                  __func__ << " stream " << stream.idx
+		                           << " packet lost too much, force input stream interrupt and reconnect. "
+		                           << get_ingest_stats(stream.idx).str());
+	}
+}
+
+// link health of the stream behind output idx, safe to call from any thread while the node runs. An unknown idx
+// reads as a stream that never connected
+IngestStats::Snapshot StreamDemuxPoolCalculator::get_ingest_stats(uint32_t idx) const
+{
+	if (idx >= streams.size()) {
+		return IngestStats::Snapshot();
+	}
+	return streams[idx]->stats.snapshot(now_us());
+}
+
+// enqueues the stream's queued packets while it has fewer than DEMUX_POOL_OUTPUT_CREDITS in flight downstream, so
+// enqueue never waits on a full consumer. Returns false when packets are left queued for lack of credits
+bool StreamDemuxPoolCalculator::send_vpackets(DemuxPoolStream& stream)
+{
+	auto& in_flight = stream.in_flight;
+	in_flight.erase(remove_if(in_flight.begin(), in_flight.end(),
+	                          [](const DemuxPoolInFlight& p) { return p.vpacket.use_count() <= p.base_use_cnt; }),
+	                in_flight.end());
+	PacketPtr<VideoPacket> vpacket;
+	while (in_flight.size() < DEMUX_POOL_OUTPUT_CREDITS && stream.ring.try_pop(vpacket)) {
+		// the pool's reference, if pooled, and this one
+		long base_use_cnt = vpacket.use_count();
+		ErrorCode ec;
+		if ((ec = node->enqueue(stream.idx, vpacket)) != ErrorCode::OK) {
+			AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_ERROR,
+			                  __func__ << " vpacket(pts:" << vpacket->get_pres_timestamp() << ") enqueue to "
+			                           << node->output_streams[stream.idx].first << " failed. Error code:" << ec);
+			continue;
+		}
+		in_flight.push_back({std::move(vpacket), base_use_cnt});
+	}
+	return in_flight.size() < DEMUX_POOL_OUTPUT_CREDITS || !stream.ring.size();
+}
+
+// one of at most DEMUX_POOL_DISPATCH_THREADS, sending the streams assigned to it. A consumer that stops taking
+// packets only pauses its own stream: the dispatcher moves on to the others, and the paused stream's ring sheds to
+// the next key frame (live) or holds its reader (file) until credits return. The last dispatcher to drain a
+// finished stream finishes the graph
+void StreamDemuxPoolCalculator::dispatch_thread(DemuxPoolDispatcher* dispatcher)
+{
+	AUP_AVAF_HANDLE_THREAD_NAME();
+	for (auto stream : dispatcher->streams) {
+		stream->last_io_cruise_us = stream->last_stats_log_us = now_us();
+	}
+	uint32_t drained = 0;
+	while (running_ && drained < dispatcher->streams.size()) {
+		if (node->get_graph_status() != GraphStatus::RUNNING) {
+			usleep(10000);
+			continue;
+		}
+		// cleared before the rings are read, so a push during the pass wakes the next wait at once
+		dispatcher->pushed.store(false, memory_order_relaxed);
+		atomic_thread_fence(memory_order_seq_cst);
+		bool paused = false;
+		for (auto stream : dispatcher->streams) {
+			if (stream->drained) {
+				continue;
+			}
+			// read before the pops: once finished is seen every packet was pushed, so an empty ring means all are out
+			bool finished = stream->finished;
+			bool sent     = send_vpackets(*stream);
+			if (!sent && !stream->output_paused) {
+				stream->output_pause_cnt++;
+			}
+			stream->output_paused = !sent;
+			paused |= !sent;
+			if (finished && !stream->ring.size()) {
+				stream->drained = true;
+				drained++;
+				if (++drained_cnt == streams.size()) {
+					node->set_graph_status(GraphStatus::FINISHED);
+				}
+				continue;
+			}
+			uint64_t now = now_us();
+			if (now - stream->last_io_cruise_us > IO_NETWORK_CRUISE_INTERVAL) {
+				if (options->demux().auto_reconnect()) {
+					check_stalled_stream(*stream);
+				}
+				stream->last_io_cruise_us = now;
+			}
+			if (now - stream->last_stats_log_us > DEMUX_POOL_STATS_LOG_INTERVAL_US) {
+				AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+				                  __func__ << " stream " << stream->idx << " output paused " << stream->output_pause_cnt
+				                           << " times, ingest " << get_ingest_stats(stream->idx).str());
+				stream->last_stats_log_us = now;
+			}
+		}
+		dispatcher->wait(paused ? DEMUX_POOL_CREDIT_POLL_US : DEMUX_POOL_WAIT_US, running_);
+	}
+}
+
+ErrorCode StreamDemuxPoolCalculator::initialize(string& err_str)
+{
+	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO, __func__ << " stream demux pool options:");
+	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+	                  "        rtsp_transport = " << options->demux().rtsp_transport());
+	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+	                  "        force_fps = " << options->demux().force_fps());
+	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+	                  "        iframe_extract = " << options->demux().iframe_extract());
+	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+	                  "        auto_reconnect = " << options->demux().auto_reconnect());
+
+	// input_url holds the urls separated by white space, in output order
+	string input_urls = node->get_input_url();
+	if (!input_urls.size()) {
+		input_urls = options->demux().input_url();
+	}
+	istringstream url_stream(input_urls);
+	string url;
+	while (url_stream >> url) {
+		// the url fragment keys of stream_demux are not parsed here, the whole url goes to ffmpeg; sampling in
+		// particular is unsupported, iframe_extract is the only packet selection of the pool
+		size_t fragment_pos = url.rfind('#');
+		if (fragment_pos != string::npos && url.find("sample=", fragment_pos) != string::npos) {
+			err_str = "sample= is not supported by stream_demux_pool, use stream_demux or iframe_extract: " + url;
+			return ErrorCode::ERROR;
+		}
+		streams.emplace_back(make_unique<DemuxPoolStream>());
+		streams.back()->idx     = streams.size() - 1;
+		streams.back()->url     = url;
+		streams.back()->live    = get_url_type(url) == UrlType::LIVE_STREAM;
+		streams.back()->running = &running_;
+	}
+	uint32_t stream_cnt = streams.size();
+	if (!stream_cnt || node->output_streams.size() != stream_cnt * 2) {
+		err_str = "input_url must list one url per output pair, got " + to_string(stream_cnt) + " urls for " +
+		          to_string(node->output_streams.size()) + " outputs";
+		return ErrorCode::ERROR;
+	}
+
+	running_ = true;
+	for (auto& stream : streams) {
+		if (!stream_open(*stream)) {
+			err_str = "issue opennig stream " + stream->url;
+			return ErrorCode::ERROR;
+		}
+		auto ec = node->enqueue(stream_cnt + stream->idx, stream->vid_stream_info_packet);
+		if (ec != ErrorCode::OK) {
+			err_str = "issue enqueueing side packet: " + get_ec_desc(ec);
+			return ec;
+		}
+	}
+	if (options->demux().is_dummy()) {
+		return ErrorCode::OK;
+	}
+	// a fixed share of the streams per dispatcher keeps every ring single consumer
+	dispatchers.resize(std::min(stream_cnt, (uint32_t)DEMUX_POOL_DISPATCH_THREADS));
+	for (auto& dispatcher : dispatchers) {
+		dispatcher.reset(new DemuxPoolDispatcher());
+	}
+	for (auto& stream : streams) {
+		stream->dispatcher = dispatchers[stream->idx % dispatchers.size()].get();
+		stream->dispatcher->streams.push_back(stream.get());
+	}
+	for (auto& stream : streams) {
+		stream->reader_thread_id = thread(&StreamDemuxPoolCalculator::reader_thread, this, stream.get());
+	}
+	for (auto& dispatcher : dispatchers) {
+		dispatcher->thread_id = thread(&StreamDemuxPoolCalculator::dispatch_thread, this, dispatcher.get());
+	}
+	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+	                  __func__ << " demuxing " << stream_cnt << " streams on " << stream_cnt << " reader and "
+	                           << dispatchers.size() << " dispatch threads");
+	return ErrorCode::OK;
+}
+
+AUP_AVAF_REGISTER_CALCULATOR_EXT("Aupera", "stream_demux_pool", StreamDemuxPoolCalculator, StreamMuxOptions, false,
+                                 "Aupera's multi-url stream demux calclulator.", {})
@@ -0,0 +1,170 @@
+#pragma once
+
+#include "aup/avaf/config.h"
+
+// std headers
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <thread>
+#include <unistd.h>
+
+// sdk headers
+#include <boost/log/common.hpp>
+
+// sdk headers (ffmpeg)
+extern "C"
+{
+#include "libavcodec/avcodec.h"
+#if AUP_AVAF_PLATFORM_IS_U30_HOST
+#include "libavcodec/bsf.h"
+#endif
+#include "libavformat/avformat.h"
+#include "libavutil/avutil.h"
+#include "libavutil/mathematics.h"
+}
+
+// avaf headers
+#include "aup/avaf/calculator.h"
+#include "aup/avaf/graph.h"
+#include "aup/avaf/node.h"
+#include "aup/avaf/packets/video_packet.h"
+#include "aup/avaf/packets/video_stream_info_packet.h"
+#include "aup/avaf/utils.h"
+#include "aup/avap/stream_mux.pb.h"
+
+// local headers
+#include "../stream_demux/ingest_stats.h"
+#include "../stream_demux/spsc_ring.h"
+#include "../stream_demux/video_packet_pool.h"
+
+using namespace std;
+using namespace aup::avaf;
+
+#define FF_AVFORMATCTX_OPEN_WAIT 30000000 // 30s
+#define FF_MAX_SUPPORT_FPS 90
+#define EXTRADATA_MAX_LEN 256
+#define IO_NETWORK_CRUISE_INTERVAL 10000000
+#define DEMUX_POOL_RING_SIZE 256        // packets buffered per stream between its reader and its dispatcher
+#define DEMUX_POOL_PACKET_POOL_SIZE 512 // recycled VideoPackets per stream
+#define DEMUX_POOL_WAIT_US 10000        // longest dispatcher sleep on empty rings before it rechecks its state
+#define DEMUX_POOL_DISPATCH_THREADS 4   // threads sending the rings downstream, capped at the stream count
+#define DEMUX_POOL_OUTPUT_CREDITS 8     // packets of a stream held downstream before its sends pause; at or below
+                                        // the consumer's input queue size, enqueue never waits for room
+#define DEMUX_POOL_CREDIT_POLL_US 1000  // dispatcher recheck period while an output is out of credits
+#define DEMUX_POOL_RECONNECT_MAX_MS 60000
+#define DEMUX_POOL_STATS_LOG_INTERVAL_US 60000000 // period of the per stream ingest statistics log
+
+struct DemuxPoolDispatcher;
+
+// a packet enqueued downstream, with its use count before the send: once the count is back there the consumer
+// released it
+struct DemuxPoolInFlight
+{
+	PacketPtr<VideoPacket> vpacket;
+	long base_use_cnt = 0;
+};
+
+// ingest state of one input url. Its reader thread is the only one touching the format context; its dispatcher
+// only pops the ring and flags a stalled stream through force_interrupt
+struct DemuxPoolStream
+{
+	uint32_t idx = 0;
+	string url;
+	bool live                         = false;
+	const atomic<bool>* running       = NULL;
+	AVFormatContext* fmt_ctx          = NULL;
+	AVBSFContext* av_bsf_ctx          = NULL;
+	int32_t v_stream_idx              = -1;
+	uint32_t v_frame_duration         = 0;
+	bool got_1st_key_frame            = false;
+	bool ring_wait_key_frame          = false;
+	timestamp_t last_pts              = timestamp_max;
+	timestamp_t sync_timestamp_offset = 0;
+	uint64_t io_open_start_ts         = 0;
+	PacketPtr<VideoStreamInfoPacket> vid_stream_info_packet;
+	SpscRing<PacketPtr<VideoPacket>> ring{DEMUX_POOL_RING_SIZE};
+	VideoPacketPool vpacket_pool{DEMUX_POOL_PACKET_POOL_SIZE};
+	IngestStats stats;
+	thread reader_thread_id;
+	DemuxPoolDispatcher* dispatcher = NULL; // the thread popping the ring, woken after each push
+	atomic<bool> is_av_io_open{false};
+	atomic<bool> io_read_force_interrupt{false};
+	atomic<bool> finished{false}; // the reader stopped for good, end of file or reconnect disabled
+	atomic<uint32_t> read_vpck_cnt_period{0};
+	uint64_t read_vpck_cnt = 0;
+	uint64_t drop_cnt      = 0;
+	uint64_t reconnect_cnt = 0;
+	// dispatcher only
+	deque<DemuxPoolInFlight> in_flight;
+	bool output_paused         = false; // queued packets wait for credits
+	uint64_t output_pause_cnt  = 0;
+	bool drained               = false;
+	uint64_t last_io_cruise_us = 0;
+	uint64_t last_stats_log_us = 0;
+
+	~DemuxPoolStream();
+};
+
+// sends the rings of a fixed share of the streams downstream, as the only consumer of each. Readers wake it after
+// a push through the same fence handshake as SpscRing; an output out of credits is polled instead, the consumer
+// releasing a packet wakes nothing
+struct DemuxPoolDispatcher
+{
+	vector<DemuxPoolStream*> streams;
+	thread thread_id;
+	mutex m;
+	condition_variable wakeup;
+	atomic<bool> waiting{false};
+	atomic<bool> pushed{false}; // a reader pushed since the dispatcher's last pass started
+
+	void wake()
+	{
+		pushed.store(true, memory_order_relaxed);
+		atomic_thread_fence(memory_order_seq_cst);
+		if (waiting.load(memory_order_relaxed)) {
+			lock_guard<mutex> lock(m);
+			wakeup.notify_one();
+		}
+	}
+
+	void wait(int64_t timeout_us, const atomic<bool>& running)
+	{
+		unique_lock<mutex> lock(m);
+		waiting.store(true, memory_order_relaxed);
+		atomic_thread_fence(memory_order_seq_cst);
+		wakeup.wait_for(lock, chrono::microseconds(timeout_us),
+		                [&] { return pushed.load(memory_order_relaxed) || !running; });
+		waiting.store(false, memory_order_relaxed);
+	}
+};
+
+class StreamDemuxPoolCalculator : public CalculatorBase<StreamMuxOptions>
+{
+	vector<unique_ptr<DemuxPoolStream>> streams;
+	vector<unique_ptr<DemuxPoolDispatcher>> dispatchers;
+	mutex m;
+	condition_variable stopping; // wakes readers backing off between reconnects
+	atomic<uint32_t> drained_cnt{0}; // streams finished with every packet sent
+	atomic<bool> running_{false};
+	bool stream_open(DemuxPoolStream& stream);
+	void stream_close(DemuxPoolStream& stream);
+	bool read_vpacket(DemuxPoolStream& stream);
+	void push_vpacket(DemuxPoolStream& stream, PacketPtr<VideoPacket>& vpacket, bool key_frame);
+	void reader_thread(DemuxPoolStream* stream);
+	void dispatch_thread(DemuxPoolDispatcher* dispatcher);
+	bool send_vpackets(DemuxPoolStream& stream);
+	void check_stalled_stream(DemuxPoolStream& stream);
+
+protected:
+	ErrorCode fill_contract(shared_ptr<Contract>& contract, string& err_str) override;
+
+public:
+	StreamDemuxPoolCalculator(const Node* node) : CalculatorBase(node) { ffmpeg_init(); }
+	virtual ~StreamDemuxPoolCalculator();
+	ErrorCode initialize(string& err_str) override;
+	IngestStats::Snapshot get_ingest_stats(uint32_t idx) const;
+};
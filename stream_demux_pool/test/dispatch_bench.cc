@@ -0,0 +1,176 @@
+// std headers
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// local headers
+#include "../../stream_demux/spsc_ring.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// stream_demux_pool's defaults
+#define RING_SIZE 256
+#define OUTPUT_CREDITS 8
+#define CREDIT_POLL_US 1000
+#define KEY_FRAME_INTERVAL 25
+
+using BenchPacketPtr = shared_ptr<int>;
+
+static int64_t now_us() { return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count(); }
+
+// stands in for a downstream data stream: enqueue waits while queue_size packets are queued, like the SDK's
+// enqueue on a full consumer
+struct Output
+{
+	mutex m;
+	condition_variable cv;
+	deque<BenchPacketPtr> queue;
+	size_t queue_size = OUTPUT_CREDITS;
+	bool closed       = false;
+
+	void enqueue(const BenchPacketPtr& pkt)
+	{
+		unique_lock<mutex> lock(m);
+		cv.wait(lock, [&] { return closed || queue.size() < queue_size; });
+		queue.push_back(pkt);
+		cv.notify_all();
+	}
+
+	bool pop(BenchPacketPtr& pkt)
+	{
+		unique_lock<mutex> lock(m);
+		cv.wait(lock, [&] { return closed || !queue.empty(); });
+		if (queue.empty()) {
+			return false;
+		}
+		pkt = std::move(queue.front());
+		queue.pop_front();
+		cv.notify_all();
+		return true;
+	}
+
+	void close()
+	{
+		lock_guard<mutex> lock(m);
+		closed = true;
+		cv.notify_all();
+	}
+};
+
+struct Stream
+{
+	SpscRing<BenchPacketPtr> ring{RING_SIZE};
+	Output output;
+	deque<pair<BenchPacketPtr, long>> in_flight;
+	bool wait_key_frame = false;
+	uint64_t read_cnt   = 0;
+	uint64_t drop_cnt   = 0;
+	atomic<uint64_t> delivered_cnt{0};
+};
+
+// streams packets at fps each into their rings (dropping up to the next key frame on a full ring, as a live
+// reader does) for duration_s, while dispatch_cnt threads send the rings to the outputs. Every consumer takes a
+// packet per frame except output 0's, which stops taking packets. Prints per stream delivered and dropped packets
+static void run(const char* name, bool credits, int stream_cnt, int dispatch_cnt, int fps, int duration_s)
+{
+	vector<unique_ptr<Stream>> streams;
+	for (int i = 0; i < stream_cnt; i++) {
+		streams.emplace_back(new Stream());
+	}
+	atomic<bool> running{true};
+	vector<thread> threads;
+	for (int i = 1; i < stream_cnt; i++) {
+		threads.emplace_back([&, i] {
+			BenchPacketPtr pkt;
+			while (streams[i]->output.pop(pkt)) {
+				pkt.reset();
+				streams[i]->delivered_cnt++;
+			}
+		});
+	}
+	for (int d = 0; d < dispatch_cnt; d++) {
+		threads.emplace_back([&, d] {
+			while (running) {
+				bool idle = true;
+				for (int i = d; i < stream_cnt; i += dispatch_cnt) {
+					Stream& s = *streams[i];
+					BenchPacketPtr pkt;
+					if (!credits) {
+						while (running && s.ring.try_pop(pkt)) {
+							s.output.enqueue(pkt);
+							idle = false;
+						}
+						continue;
+					}
+					auto& in_flight = s.in_flight;
+					in_flight.erase(remove_if(in_flight.begin(), in_flight.end(),
+					                          [](const pair<BenchPacketPtr, long>& p) {
+						                          return p.first.use_count() <= p.second;
+					                          }),
+					                in_flight.end());
+					while (in_flight.size() < OUTPUT_CREDITS && s.ring.try_pop(pkt)) {
+						long base = pkt.use_count();
+						s.output.enqueue(pkt);
+						in_flight.emplace_back(std::move(pkt), base);
+						idle = false;
+					}
+				}
+				if (idle) {
+					this_thread::sleep_for(microseconds(CREDIT_POLL_US));
+				}
+			}
+		});
+	}
+	int64_t start = now_us();
+	for (uint64_t frame = 0; now_us() - start < duration_s * 1000000LL; frame++) {
+		int64_t due = start + (int64_t)(frame * 1e6 / fps);
+		while (now_us() < due) {
+			this_thread::sleep_for(microseconds(200));
+		}
+		for (auto& s : streams) {
+			bool key_frame = frame % KEY_FRAME_INTERVAL == 0;
+			s->read_cnt++;
+			if (s->wait_key_frame && !key_frame) {
+				s->drop_cnt++;
+				continue;
+			}
+			auto pkt          = make_shared<int>(0);
+			s->wait_key_frame = !s->ring.try_push(pkt);
+			s->drop_cnt += s->wait_key_frame;
+		}
+	}
+	running = false;
+	for (auto& s : streams) {
+		s->output.close();
+	}
+	for (auto& t : threads) {
+		t.join();
+	}
+	cout << name << " (" << stream_cnt << " streams, " << dispatch_cnt << " dispatch threads, output 0 stalled)"
+	     << endl;
+	for (int i = 0; i < stream_cnt; i++) {
+		Stream& s = *streams[i];
+		cout << "  stream " << setw(2) << i << " read:" << s.read_cnt << " delivered:" << s.delivered_cnt
+		     << " dropped:" << s.drop_cnt << endl;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int stream_cnt   = argc > 1 ? stoi(argv[1]) : 8;
+	int dispatch_cnt = argc > 2 ? stoi(argv[2]) : 4;
+	int duration_s   = argc > 3 ? stoi(argv[3]) : 5;
+	run("blocking enqueue", false, stream_cnt, dispatch_cnt, 25, duration_s);
+	run("output credits", true, stream_cnt, dispatch_cnt, 25, duration_s);
+	return 0;
+}
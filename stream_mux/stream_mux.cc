@@ -6,7 +6,6 @@
 #include <chrono>
 
 // avaf headers
-#include "aup/avaf/packets/video_packet.h"
 #include "aup/avaf/thread_name.h"
 
 // #define AUP_AVAF_DBG_ENABLE (1)
@@ -16,7 +15,19 @@ using namespace std::chrono;
 
 StreamMuxCalculator::StreamMuxCalculator(const Node* node) : CalculatorBase(node) { ffmpeg_init(); }
 
-StreamMuxCalculator::~StreamMuxCalculator() { stream_close(); }
+StreamMuxCalculator::~StreamMuxCalculator()
+{
+	// the writer drains what is queued first, only a write still stuck at the deadline is interrupted
+	stop_deadline_us = get_now_us() + MUX_DRAIN_TIMEOUT_US;
+	running_         = false;
+	AUP_AVAF_THREAD_JOIN_NOTERM(writer_thread_id);
+	stream_close();
+	if (queue_drop_cnt || reconnect_drop_cnt) {
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+		                  __func__ << " wrote " << writeVpktCnt << " vpackets, dropped " << queue_drop_cnt
+		                           << " on a full write queue and " << reconnect_drop_cnt << " while reconnecting");
+	}
+}
 
 // input index 0: video packet
 // input index 1: side packet of AVCodecContext
@@ -50,30 +61,13 @@ bool StreamMuxCalculator::stream_delay_open()
 	return stream_open();
 }
 
+// only queues the packet for the writer thread and never blocks: when the queue is full the packet is dropped and
+// so is everything up to the next key frame, so a slow or dead output never backs up the encoder
 ErrorCode StreamMuxCalculator::execute()
 {
 	AUP_AVAF_TRACE();
 	PacketPtr<const VideoPacket> rvpkt = nullptr;
 
-	if (write_cont_failed_no > 100 && options->mux().auto_reconnect()) {
-		stream_close();
-		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
-		                  __func__ << " ready to reconnect output stream " << output_url);
-		ioWriteForceInterrupt = 0;
-		if (stream_open()) {
-			uint32_t sleepMs = std::min(5 + (++reconn_cont_failed_no / 5) * 5, (uint32_t)60) * 1000;
-			for (uint32_t i = 0; i < sleepMs; i++) {
-				usleep(1000);
-			}
-			AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_ERROR,
-			                  __func__ << " reconnect output stream " << output_url << " failed");
-		} else {
-			AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
-			                  __func__ << " reconnect output stream " << output_url << " done");
-			reconn_cont_failed_no = 0;
-		}
-		write_cont_failed_no = 0;
-	}
 	auto ec = node->get_packet(0, rvpkt);
 	if (ec != ErrorCode::OK) {
 		return ec;
@@ -83,45 +77,115 @@ ErrorCode StreamMuxCalculator::execute()
 	                  __func__ << " muxer receive a packet, len:" << rvpkt->len
 	                           << " pts:" << rvpkt->get_pres_timestamp());
 
-	if (pFmtCtx) {
-		writeVpktCnt++;
+	if (queue_wait_key_frame && rvpkt->picType != PicType::I) {
+		queue_drop_cnt++;
+		return ErrorCode::OK;
+	}
+	queue_wait_key_frame = !write_queue.try_push(rvpkt);
+	if (queue_wait_key_frame) {
+		queue_drop_cnt++;
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
+		                  __func__ << " write queue full, dropping packets up to the next key frame");
+	}
+	return ErrorCode::OK;
+}
+
+void StreamMuxCalculator::write_vpacket(const PacketPtr<const VideoPacket>& rvpkt)
+{
+	if (!pFmtCtx) {
+		return;
+	}
+	writeVpktCnt++;
 #if AUP_AVAF_PLATFORM_IS_U30_HOST || AUP_AVAF_PLATFORM_IS_KRIA_SOM
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wdeprecated-declarations"
 #endif
-		av_init_packet(&(avpkt));
+	av_init_packet(&(avpkt));
 #if AUP_AVAF_PLATFORM_IS_U30_HOST || AUP_AVAF_PLATFORM_IS_KRIA_SOM
 #pragma GCC diagnostic pop
 #endif
-		avpkt.size         = rvpkt->len;
-		avpkt.data         = rvpkt->pBuf;
-		avpkt.stream_index = vStreamIdx;
-		avpkt.duration     = av_rescale_q((int64_t)vframeDuration, cq, pFmtCtx->streams[vStreamIdx]->time_base);
-		avpkt.flags        = (rvpkt->picType == PicType::I) ? AV_PKT_FLAG_KEY : 0;
-		avpkt.pos          = -1;
-		avpkt.pts = av_rescale_q((int64_t)rvpkt->get_pres_timestamp(), cq, pFmtCtx->streams[vStreamIdx]->time_base);
-		avpkt.dts = av_rescale_q((int64_t)rvpkt->dts, cq, pFmtCtx->streams[vStreamIdx]->time_base);
-
-		if (pVBsfCtx) {
-			av_bsf_send_packet(pVBsfCtx, &avpkt);
-			av_bsf_receive_packet(pVBsfCtx, &avpkt);
+	avpkt.size         = rvpkt->len;
+	avpkt.data         = rvpkt->pBuf;
+	avpkt.stream_index = vStreamIdx;
+	avpkt.duration     = av_rescale_q((int64_t)vframeDuration, cq, pFmtCtx->streams[vStreamIdx]->time_base);
+	avpkt.flags        = (rvpkt->picType == PicType::I) ? AV_PKT_FLAG_KEY : 0;
+	avpkt.pos          = -1;
+	avpkt.pts = av_rescale_q((int64_t)rvpkt->get_pres_timestamp(), cq, pFmtCtx->streams[vStreamIdx]->time_base);
+	avpkt.dts = av_rescale_q((int64_t)rvpkt->dts, cq, pFmtCtx->streams[vStreamIdx]->time_base);
+
+	if (pVBsfCtx) {
+		av_bsf_send_packet(pVBsfCtx, &avpkt);
+		av_bsf_receive_packet(pVBsfCtx, &avpkt);
+	}
+
+	if (avpkt.size > 0) {
+		/* mux encoded frame */
+		auto ret = av_interleaved_write_frame(pFmtCtx, &(avpkt));
+		av_packet_unref(&avpkt);
+		if (ret) {
+			av_log(NULL, AV_LOG_ERROR, "Error muxing video packet\n");
+			write_cont_failed_no++;
+		} else {
+			write_cont_failed_no = 0;
+		}
+	}
+}
+
+// reopens the output. After a failure the writer backs off while discarding whatever execute queues, so the graph
+// keeps running against a dead endpoint; either way the first packet written to the new output is a key frame
+void StreamMuxCalculator::stream_reconnect()
+{
+	stream_close();
+	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
+	                  __func__ << " ready to reconnect output stream " << output_url);
+	ioWriteForceInterrupt = 0;
+	write_cont_failed_no  = 0;
+	write_wait_key_frame  = true;
+	reconnect_pending     = !stream_open();
+	if (!reconnect_pending) {
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
+		                  __func__ << " reconnect output stream " << output_url << " done");
+		reconn_cont_failed_no = 0;
+		return;
+	}
+	stream_close();
+	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_ERROR,
+	                  __func__ << " reconnect output stream " << output_url << " failed");
+	uint32_t sleep_ms =
+	    std::min(5 + (++reconn_cont_failed_no / 5) * 5, (uint32_t)MUX_RECONNECT_MAX_MS / 1000) * 1000;
+	timestamp_t retry_us = get_now_us() + (timestamp_t)sleep_ms * 1000;
+	PacketPtr<const VideoPacket> rvpkt;
+	while (running_ && get_now_us() < retry_us) {
+		if (write_queue.pop(rvpkt, MUX_QUEUE_WAIT_US)) {
+			reconnect_drop_cnt++;
 		}
+	}
+}
 
-		if (avpkt.size > 0) {
-			/* mux encoded frame */
-			m.lock();
-			auto ret = av_interleaved_write_frame(pFmtCtx, &(avpkt));
-			m.unlock();
-			av_packet_unref(&avpkt);
-			if (ret) {
-				av_log(NULL, AV_LOG_ERROR, "Error muxing video packet\n");
-				write_cont_failed_no++;
-			} else {
-				write_cont_failed_no = 0;
+// the only thread touching the output once initialize returns. On shutdown it keeps writing until the queue is
+// empty, without reconnecting
+void StreamMuxCalculator::writer_thread()
+{
+	AUP_AVAF_HANDLE_THREAD_NAME();
+	while (running_ || write_queue.size()) {
+		if (running_ && options->mux().auto_reconnect() &&
+		    (reconnect_pending || write_cont_failed_no > MUX_WRITE_FAIL_RECONNECT)) {
+			stream_reconnect();
+			continue;
+		}
+		PacketPtr<const VideoPacket> rvpkt;
+		if (!write_queue.pop(rvpkt, MUX_QUEUE_WAIT_US)) {
+			continue;
+		}
+		if (write_wait_key_frame) {
+			if (rvpkt->picType != PicType::I) {
+				reconnect_drop_cnt++;
+				continue;
 			}
+			write_wait_key_frame = false;
 		}
+		write_vpacket(rvpkt);
 	}
-	return ErrorCode::OK;
 }
 
 ErrorCode StreamMuxCalculator::initialize(string& err_str)
@@ -139,10 +203,12 @@ ErrorCode StreamMuxCalculator::initialize(string& err_str)
 		err_str = "output url is empty";
 		return ErrorCode::ERROR;
 	}
+	running_ = true;
 	if (!stream_delay_open()) {
 		err_str = "issue openning stream";
 		return ErrorCode::ERROR;
 	}
+	writer_thread_id = thread([&] { this->writer_thread(); });
 	return ErrorCode::OK;
 }
 
@@ -150,7 +216,7 @@ int ff_interrupt_cb(void* opaque)
 {
 	StreamMuxCalculator* pOwner = (StreamMuxCalculator*)opaque;
 
-	if (pOwner->ioWriteForceInterrupt ||
+	if (pOwner->ioWriteForceInterrupt || get_now_us() > pOwner->stop_deadline_us ||
 	    (!pOwner->avioIsOpen && (duration_cast<microseconds>(system_clock::now().time_since_epoch()).count() -
 	                             pOwner->ioOpenStartTs) > FF_AVFORMATCTX_OPEN_WAIT)) {
 		return -1;
@@ -237,6 +303,7 @@ void StreamMuxCalculator::stream_close()
 		if (pFmtCtx->oformat && !(pFmtCtx->oformat->flags & AVFMT_NOFILE) && avioIsOpen) {
 			avio_close(pFmtCtx->pb);
 		}
+		avioIsOpen = false;
 		avformat_free_context(pFmtCtx);
 		pFmtCtx = NULL;
 		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO, __func__ << " close output avformat done");
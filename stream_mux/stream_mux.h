@@ -3,6 +3,7 @@
 #include "aup/avaf/config.h"
 
 // std headers
+#include <atomic>
 #include <semaphore.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -39,9 +40,13 @@ extern "C"
 #include "aup/avaf/graph.h"
 #include "aup/avaf/node.h"
 #include "aup/avaf/packets/av_codec_context_packet.h"
+#include "aup/avaf/packets/video_packet.h"
 #include "aup/avaf/utils.h"
 #include "aup/avap/stream_mux.pb.h"
 
+// local headers
+#include "../stream_demux/spsc_ring.h"
+
 using namespace std;
 using namespace aup::avaf;
 
@@ -50,15 +55,31 @@ using namespace aup::avaf;
 #define FF_MAX_SUPPORT_FPS 90
 #define EXTRADATA_MAX_LEN 256
 #define ENC_CONTEXT_WAIT_TIMEOUT 30000000
+#define MUX_QUEUE_SIZE 256            // packets buffered between execute and the writer thread
+#define MUX_QUEUE_WAIT_US 10000       // longest writer sleep on an empty queue before it rechecks its state
+#define MUX_WRITE_FAIL_RECONNECT 100  // consecutive write failures that make the writer reconnect
+#define MUX_RECONNECT_MAX_MS 60000
+#define MUX_DRAIN_TIMEOUT_US 5000000  // longest the writer may spend on the queued packets once the node stops
 
 class StreamMuxCalculator : public CalculatorBase<StreamMuxOptions>
 {
 	bool stream_open();
 	void stream_close();
 	bool stream_delay_open();
+	void stream_reconnect();
+	void write_vpacket(const PacketPtr<const VideoPacket>& rvpkt);
+	void writer_thread();
 	PacketPtr<const AVCodecContextPacket> enc_ctx;
-	mutex m;
-	uint32_t writeVpktCnt = 0;
+	SpscRing<PacketPtr<const VideoPacket>> write_queue{MUX_QUEUE_SIZE};
+	thread writer_thread_id;
+	atomic<bool> running_{false};
+	atomic<timestamp_t> stop_deadline_us{timestamp_max}; // blocking I/O is interrupted past it
+	bool queue_wait_key_frame   = false; // execute only, a packet was dropped on a full queue
+	uint64_t queue_drop_cnt     = 0;
+	bool write_wait_key_frame   = false; // writer only, the output was reopened
+	bool reconnect_pending      = false;
+	uint64_t reconnect_drop_cnt = 0;
+	uint32_t writeVpktCnt       = 0;
 	string output_url;
 	AVFormatContext* pFmtCtx            = NULL;
 	int32_t vStreamIdx                  = 0;
@@ -0,0 +1,100 @@
+#pragma once
+
+// std headers
+#include <cmath>
+#include <string>
+
+// sdk headers (ffmpeg)
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+}
+
+// avaf headers
+#include "aup/avaf/packets/video_stream_info_packet.h"
+
+#define DEC_SWS_FLAGS SWS_BILINEAR
+
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(58, 7, 100)
+#define DEC_AVFRAME_IS_KEY(f) ((f)->flags & AV_FRAME_FLAG_KEY)
+#else
+#define DEC_AVFRAME_IS_KEY(f) ((f)->key_frame)
+#endif
+// concealed frames carry garbage that downstream inference would waste cycles on
+#define DEC_AVFRAME_IS_CORRUPT(f) (((f)->flags & AV_FRAME_FLAG_CORRUPT) || (f)->decode_error_flags)
+
+// decoder setup and frame conversion shared by x86_dec and x86_dec_pool, so both open their codec contexts and
+// fill their output packets the same way
+
+// the ffmpeg decoder of the stream's codec, AV_CODEC_ID_NONE with err_str set for anything but h264 and h265
+inline AVCodecID dec_codec_id(const aup::avaf::VideoStreamInfoPacket& info, std::string& err_str)
+{
+	switch (info.codec_type) {
+		case aup::avaf::CODEC_TYPE_H264:
+			return AV_CODEC_ID_H264;
+		case aup::avaf::CODEC_TYPE_H265:
+			return AV_CODEC_ID_HEVC;
+		default:
+			err_str = "X86 only support h264 or h265 decoder type";
+			return AV_CODEC_ID_NONE;
+	}
+}
+
+// a decoder context with the stream's frame rate, size and time base, and with the low delay flags when
+// low_latency is set; threading and frame skipping are left to the caller. NULL with err_str set on failure
+inline AVCodecContext* dec_alloc_codec_ctx(const aup::avaf::VideoStreamInfoPacket& info, bool low_latency,
+                                           std::string& err_str)
+{
+	AVCodecContext* ctx = avcodec_alloc_context3(NULL);
+	if (NULL == ctx) {
+		err_str = "X86 decoder context allocate failed";
+		return NULL;
+	}
+	ctx->framerate.num = floorf(info.fps);
+	ctx->framerate.den = 1;
+	ctx->width         = info.w;
+	ctx->height        = info.h;
+	ctx->time_base     = av_inv_q(ctx->framerate);
+	if (low_latency) {
+		ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+		ctx->flags2 |= AV_CODEC_FLAG2_FAST;
+		ctx->has_b_frames = 0;
+	}
+	return ctx;
+}
+
+// finds the decoder and opens ctx with it, false with err_str set on failure
+inline bool dec_open_codec(AVCodecContext* ctx, AVCodecID codec_id, std::string& err_str)
+{
+	const AVCodec* pCodec = avcodec_find_decoder(codec_id);
+	if (NULL == pCodec) {
+		err_str = "Fail to find X86 decoder:" + std::string(avcodec_get_name(codec_id));
+		return false;
+	}
+	if (avcodec_open2(ctx, pCodec, NULL)) {
+		err_str = "Fail to open X86 decoder:" + std::string(avcodec_get_name(codec_id));
+		return false;
+	}
+	return true;
+}
+
+// fills dst's planes from the decoded frame without staging a copy of it: a dst of the native size and format
+// is plane-copied and skips swscale, anything else is scaled through the cached sws_ctx. Returns false when no
+// scaler exists for the conversion and dst was left unfilled
+inline bool dec_scale_avframe(const AVFrame* src, AVFrame* dst, SwsContext*& sws_ctx)
+{
+	if (src->width == dst->width && src->height == dst->height && src->format == dst->format) {
+		av_image_copy(dst->data, dst->linesize, (const uint8_t**)src->data, src->linesize, (AVPixelFormat)src->format,
+		              src->width, src->height);
+		return true;
+	}
+	sws_ctx = sws_getCachedContext(sws_ctx, src->width, src->height, (AVPixelFormat)src->format, dst->width,
+	                               dst->height, (AVPixelFormat)dst->format, DEC_SWS_FLAGS, NULL, NULL, NULL);
+	if (!sws_ctx) {
+		return false;
+	}
+	sws_scale(sws_ctx, src->data, src->linesize, 0, src->height, dst->data, dst->linesize);
+	return true;
+}
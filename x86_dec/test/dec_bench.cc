@@ -0,0 +1,132 @@
+// std headers
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+// sdk headers (ffmpeg)
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+using namespace std;
+using namespace std::chrono;
+
+// the decoder configurations x86_dec runs, all on ffmpeg's single decoding thread
+struct DecMode
+{
+	const char* name;
+	bool low_latency;
+	AVDiscard skip_frame;
+};
+
+static const DecMode dec_modes[] = {
+    {"default", false, AVDISCARD_DEFAULT},
+    {"low_latency", true, AVDISCARD_DEFAULT},
+    {"skip_nonref", false, AVDISCARD_NONREF},
+};
+
+// decodes every video packet of the input once and reports decode fps, process cpu time per input packet and
+// the mean time a frame spends inside the decoder (from avcodec_send_packet to avcodec_receive_frame of the same
+// pts)
+static int run_mode(const string& input, const DecMode& mode)
+{
+	AVFormatContext* fmt_ctx = NULL;
+	if (avformat_open_input(&fmt_ctx, input.c_str(), NULL, NULL) || avformat_find_stream_info(fmt_ctx, NULL) < 0) {
+		cerr << "cannot open " << input << endl;
+		return -1;
+	}
+	int v_stream_idx = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+	if (v_stream_idx < 0) {
+		cerr << "no video stream in " << input << endl;
+		avformat_close_input(&fmt_ctx);
+		return -1;
+	}
+	AVStream* stream      = fmt_ctx->streams[v_stream_idx];
+	const AVCodec* pCodec = avcodec_find_decoder(stream->codecpar->codec_id);
+	AVCodecContext* ctx   = avcodec_alloc_context3(pCodec);
+	avcodec_parameters_to_context(ctx, stream->codecpar);
+	if (mode.low_latency) {
+		ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+		ctx->flags2 |= AV_CODEC_FLAG2_FAST;
+		ctx->has_b_frames = 0;
+	}
+	ctx->skip_frame = mode.skip_frame;
+	if (avcodec_open2(ctx, pCodec, NULL)) {
+		cerr << "cannot open decoder " << avcodec_get_name(stream->codecpar->codec_id) << endl;
+		avcodec_free_context(&ctx);
+		avformat_close_input(&fmt_ctx);
+		return -1;
+	}
+
+	AVPacket* pkt  = av_packet_alloc();
+	AVFrame* frame = av_frame_alloc();
+	unordered_map<int64_t, steady_clock::time_point> send_ts;
+	uint64_t packet_cnt   = 0;
+	uint64_t frame_cnt    = 0;
+	double latency_sum_ms = 0;
+	auto start            = steady_clock::now();
+	clock_t cpu_start     = clock();
+	bool draining         = false;
+	while (true) {
+		if (!draining) {
+			if (av_read_frame(fmt_ctx, pkt) < 0) {
+				avcodec_send_packet(ctx, NULL);
+				draining = true;
+			} else if (pkt->stream_index == v_stream_idx) {
+				send_ts[pkt->pts] = steady_clock::now();
+				avcodec_send_packet(ctx, pkt);
+				packet_cnt++;
+				av_packet_unref(pkt);
+			} else {
+				av_packet_unref(pkt);
+				continue;
+			}
+		}
+		int ret;
+		while (!(ret = avcodec_receive_frame(ctx, frame))) {
+			auto it = send_ts.find(frame->pts);
+			if (it != send_ts.end()) {
+				latency_sum_ms += duration<double, milli>(steady_clock::now() - it->second).count();
+				send_ts.erase(it);
+			}
+			frame_cnt++;
+			av_frame_unref(frame);
+		}
+		if (ret == AVERROR_EOF) {
+			break;
+		}
+	}
+	double elapsed_s = duration<double>(steady_clock::now() - start).count();
+	double cpu_ms    = 1000.0 * (clock() - cpu_start) / CLOCKS_PER_SEC;
+
+	cout << left << setw(12) << mode.name << " " << stream->codecpar->width << "x" << stream->codecpar->height << " "
+	     << avcodec_get_name(stream->codecpar->codec_id) << " packets:" << packet_cnt << " frames:" << frame_cnt << " fps:" << fixed << setprecision(1)
+	     << frame_cnt / elapsed_s << " cpu_ms_per_packet:" << setprecision(2)
+	     << (packet_cnt ? cpu_ms / packet_cnt : 0) << " latency_ms:" << (frame_cnt ? latency_sum_ms / frame_cnt : 0)
+	     << endl;
+
+	av_frame_free(&frame);
+	av_packet_free(&pkt);
+	avcodec_free_context(&ctx);
+	avformat_close_input(&fmt_ctx);
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2) {
+		cerr << "usage: " << argv[0] << " <video file>" << endl;
+		return 1;
+	}
+	for (auto& mode : dec_modes) {
+		if (run_mode(argv[1], mode)) {
+			return 1;
+		}
+	}
+	return 0;
+}
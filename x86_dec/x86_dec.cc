@@ -2,10 +2,11 @@
 #include "x86_dec.h"
 
 // std headres
+#include <algorithm>
 #include <chrono>
 
 // avaf headres
-#include "aup/avaf/packets/video_packet.h"
+#include "aup/avaf/thread_name.h"
 
 // #define AUP_AVAF_DBG_ENABLE (1)
 #include "aup/avaf/avaf_dbg.h"
@@ -14,6 +15,46 @@ using namespace std::chrono;
 
 X86DecCalculator::~X86DecCalculator()
 {
+	running_ = false;
+	vpacket_queue.close();
+	decoded_avframes.close();
+	free_avframes.close();
+	AUP_AVAF_THREAD_JOIN_NOTERM(decode_thread_id);
+	AUP_AVAF_THREAD_JOIN_NOTERM(output_thread_id);
+	AVFrame* avframe;
+	while (decoded_avframes.pop(avframe) || free_avframes.pop(avframe)) {
+		av_frame_free(&avframe);
+	}
+	for (uint32_t i = 0; i < (uint32_t)output_drop_cnts.size(); i++) {
+		if (output_drop_cnts[i]) {
+			AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+			                  __func__ << " " << output_drop_cnts[i] << " frames dropped on full or unscalable output "
+			                           << node->output_streams[i].first);
+		}
+	}
+	if (shed_cnt) {
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+		                  __func__ << " skipped non-reference frames " << shed_cnt
+		                           << " times while every output was full");
+	}
+	if (resync_cnt) {
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+		                  __func__ << " " << decode_error_cnt << " decode errors, " << corrupt_frame_cnt
+		                           << " corrupt frames, " << resync_cnt << " resyncs dropped " << resync_drop_cnt
+		                           << " frames");
+	}
+	for (auto& sws_ctx : sws_ctxs) {
+		sws_freeContext(sws_ctx);
+	}
+	for (auto& o_avframe : o_avframes) {
+		av_frame_free(&o_avframe);
+	}
+	for (auto& pending_avframe : pending_avframes) {
+		av_frame_free(&pending_avframe);
+	}
+	if (recv_avframe) {
+		av_frame_free(&recv_avframe);
+	}
 	if (av_codec_ctx) {
 		avcodec_free_context(&av_codec_ctx);
 	}
@@ -45,9 +86,19 @@ ErrorCode X86DecCalculator::fill_contract(shared_ptr<Contract>& contract, string
 ErrorCode X86DecCalculator::execute()
 {
 	PacketPtr<const VideoPacket> vpacket = nullptr;
-	ErrorCode ec;
 	if (node->get_packet(0, vpacket) == ErrorCode::OK) {
 		AUP_AVAF_DBG("dequeue. sts:" << vpacket->get_sync_timestamp() << " now:" << get_now_us());
+		// blocks while the decoder is DEC_PACKET_QUEUE_SIZE packets behind, which is the backpressure upstream sees
+		vpacket_queue.push(vpacket);
+	}
+	return ErrorCode::OK;
+}
+
+void X86DecCalculator::decode_thread()
+{
+	AUP_AVAF_HANDLE_THREAD_NAME();
+	PacketPtr<const VideoPacket> vpacket = nullptr;
+	while (running_ && vpacket_queue.pop(vpacket)) {
 		send_vpacket_cnt++;
 #if AUP_AVAF_PLATFORM_IS_U30_HOST || AUP_AVAF_PLATFORM_IS_KRIA_SOM
 #pragma GCC diagnostic push
@@ -62,12 +113,29 @@ ErrorCode X86DecCalculator::execute()
 		send_vpacket.size = vpacket->len;
 		send_vpacket.data = vpacket->pBuf;
 		send_vpacket.pos  = -1;
-		if (avcodec_send_packet(av_codec_ctx, &send_vpacket)) {
-
+		if (resyncing && ++resync_packet_cnt > DEC_RESYNC_MAX_PACKETS) {
+			resyncing = false;
+			AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
+			                  __func__ << " no key frame within " << DEC_RESYNC_MAX_PACKETS
+			                           << " packets after a decode error, resuming on any frame");
+		}
+		AVDiscard discard = AVDISCARD_DEFAULT;
+		if (shedding_load) {
+			// every output is dropping frames, so decoding frames no later frame references is wasted work
+			discard = AVDISCARD_NONREF;
+		}
+		if (resyncing) {
+			// nothing before the next key frame is output, so the decoder does not need to reconstruct it
+			discard = max(discard, AVDISCARD_NONKEY);
+		}
+		av_codec_ctx->skip_frame = discard;
+		int ret                  = avcodec_send_packet(av_codec_ctx, &send_vpacket);
+		if (ret < 0 && ret != AVERROR(EAGAIN)) {
+			decode_error_cnt++;
 			AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_ERROR,
 			                  __func__ << " send " << send_vpacket_cnt << " vpkt failed, len:" << send_vpacket.size
-			                           << ", pts:" << send_vpacket.pts);
-
+			                           << ", pts:" << send_vpacket.pts << ", error:" << ret);
+			start_resync("send packet failed");
 		} else {
 
 			AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
@@ -75,92 +143,204 @@ ErrorCode X86DecCalculator::execute()
 			                           << ", pts:" << send_vpacket.pts);
 		}
 		av_packet_unref(&send_vpacket);
-	}
+		vpacket = nullptr;
 
-	// try to receive decoded vpics
-	while (node->get_graph_status() == GraphStatus::RUNNING) {
-		AVFrame* recv_avframe = av_frame_alloc();
-		if (!recv_avframe) {
-			return ErrorCode::NO_MEMORY;
-		}
-		// TODO handle INVAL error case (here assumption is that only error is AGAIN)
-		if (!avcodec_receive_frame(av_codec_ctx, recv_avframe)) {
+		// try to receive decoded vpics
+		while (running_ && !(ret = avcodec_receive_frame(av_codec_ctx, recv_avframe))) {
 			recv_img_packet_cnt++;
 
 			AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
 			                  __func__ << " recv " << recv_img_packet_cnt << " frame, pts:" << recv_avframe->pts);
 
-			src_basic_image_packet->fill_with_ffmpeg_avframe(recv_avframe);
-			src_basic_image_packet->set_pres_timestamp(recv_avframe->pts);
-
-			vector<PacketPtr<ImagePacket>> calc_output_img_packets;
-			/* allocate output vframes and do conversion with corresponding resolution and pixfmt */
-			timestamp_t this_pts        = recv_avframe->pts + pts_offset;
-			timestamp_t this_pts_now_us = get_now_us();
-			if (this_pts <= last_pts) {
-				timestamp_t pts_offset_change =
-				    ((this_pts_now_us - last_pts_now_us) / frame_distance_us) * frame_distance_us;
-				pts_offset += pts_offset_change;
-				this_pts += pts_offset_change;
+			bool corrupt = DEC_AVFRAME_IS_CORRUPT(recv_avframe);
+			if (corrupt) {
+				corrupt_frame_cnt++;
+				start_resync("corrupt frame");
+			}
+			if (resyncing) {
+				if (corrupt || !DEC_AVFRAME_IS_KEY(recv_avframe)) {
+					resync_drop_cnt++;
+					av_frame_unref(recv_avframe);
+					continue;
+				}
+				resyncing = false;
 				AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
-				                  AUP_AVAF_TERM_COLOR_FG_MAGENTA "PTS value dropped. Decoder will increase PTS offset "
-				                                                 "value accordingly" AUP_AVAF_TERM_FORMAT_RESET_ALL);
+				                  __func__ << " resynced on key frame, pts:" << recv_avframe->pts << ", "
+				                           << resync_drop_cnt << " frames dropped so far");
 			}
-			if (this_pts <= last_pts) {
-				timestamp_t pts_offset_change = last_pts - this_pts + frame_distance_us;
-				pts_offset += pts_offset_change;
-				this_pts += pts_offset_change;
+
+			// hand the frame to the output thread, waiting for a free shell while it is DEC_FRAME_QUEUE_SIZE
+			// frames behind
+			AVFrame* avframe;
+			if (!free_avframes.pop(avframe)) {
+				av_frame_unref(recv_avframe);
+				return;
 			}
-			bool image_packet_dropped = false;
-			for (auto& allocator : image_allocators) {
-				PacketPtr<ImagePacket> img_packet;
-				while (node->get_graph_status() == GraphStatus::RUNNING) {
-					img_packet = make_packet<ImagePacket>(this_pts, false, allocator, ec);
-					if (ec == ErrorCode::OK) {
-						calc_output_img_packets.push_back(img_packet);
-						break;
-					}
-					if (options->drop_packet_on_full_data_stream()) {
-						image_packet_dropped = true;
-						av_frame_free(&recv_avframe);
-						break;
-					}
-					usleep(100);
-				}
-				if (image_packet_dropped) {
-					break;
-				}
-				if (node->get_graph_status() != GraphStatus::RUNNING) {
-					return ErrorCode::OK;
-				}
-				img_packet->set_pres_timestamp(this_pts);
+			av_frame_move_ref(avframe, recv_avframe);
+			if (!decoded_avframes.push(avframe)) {
+				av_frame_free(&avframe);
+				return;
 			}
-			if (image_packet_dropped) {
-				continue;
+		}
+		if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+			decode_error_cnt++;
+			AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_ERROR,
+			                  __func__ << " recv frame failed after " << send_vpacket_cnt << " vpkt, error:" << ret);
+			start_resync("receive frame failed");
+		}
+	}
+}
+
+// drops everything up to the next clean key frame; there is no feedback path to ask upstream for one, so this
+// relies on the source's own GOP
+void X86DecCalculator::start_resync(const string& reason)
+{
+	if (resyncing) {
+		return;
+	}
+	resyncing         = true;
+	resync_packet_cnt = 0;
+	resync_cnt++;
+	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
+	                  __func__ << " " << reason << " after " << send_vpacket_cnt
+	                           << " vpkts, dropping frames until the next key frame");
+}
+
+void X86DecCalculator::output_thread()
+{
+	AUP_AVAF_HANDLE_THREAD_NAME();
+	AVFrame* avframe;
+	uint32_t output_cnt = image_allocators.size();
+	while (running_) {
+		uint32_t pending_cnt = count(output_pending.begin(), output_pending.end(), true);
+		// the image allocators have no release notification, so an output waiting for its downstream pool is
+		// retried every DEC_OUTPUT_RETRY_US, or as soon as a newer frame supersedes its pending one. With every
+		// output waiting nothing is popped, so the frame queue fills and the decode thread blocks
+		bool popped = false;
+		if (pending_cnt == output_cnt) {
+			decoded_avframes.wait_closed_for(microseconds(DEC_OUTPUT_RETRY_US));
+		} else if (pending_cnt) {
+			popped = decoded_avframes.pop_for(avframe, microseconds(DEC_OUTPUT_RETRY_US));
+		} else if (!(popped = decoded_avframes.pop(avframe))) {
+			break;
+		}
+		if (popped) {
+			queue_avframe(avframe);
+			// the outputs hold their own references, hand the shell back to the decode thread
+			av_frame_unref(avframe);
+			if (!free_avframes.push(avframe)) {
+				av_frame_free(&avframe);
 			}
-			last_pts        = this_pts;
-			last_pts_now_us = this_pts_now_us;
-			multi_output_scaler.do_scale(src_basic_image_packet, calc_output_img_packets);
-			for (uint32_t i = 0; i < (uint32_t)calc_output_img_packets.size(); i++) {
-				auto& img_packet = calc_output_img_packets.at(i);
-				img_packet->set_fps(i_vid_stream_info->fps);
-				cv::Size img_dims;
-				img_packet->get_dims(img_dims);
-				if ((ec = node->enqueue(i, img_packet)) != ErrorCode::OK) {
-					AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_ERROR,
-					                  "img_packet(pts:" << img_packet->get_pres_timestamp() << ") enqueue to "
-					                                    << node->output_streams[i].first << " failed: " << ec);
-				}
-				AUP_AVAF_DBG("enqueue. sts:" << img_packet->get_sync_timestamp() << " now:" << get_now_us());
+		}
+		uint32_t drop_cnt = 0;
+		for (uint32_t i = 0; i < output_cnt; i++) {
+			if (output_pending[i]) {
+				output_avframe(i, drop_cnt);
 			}
+		}
+		// shed decode work while no output has room, and resume full decoding as soon as one takes a frame again
+		bool shed = popped && drop_cnt == output_cnt;
+		if (popped && shed != shedding_load) {
+			shedding_load = shed;
+			shed_cnt += shed;
+			AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+			                  __func__ << (shed ? " every output full, skipping non-reference frames"
+			                                    : " output drained, decoding every frame"));
+		}
+	}
+}
 
-			av_frame_free(&recv_avframe);
+// stamps the decoded frame and makes it the next frame of every output. An output that has not delivered its
+// previous frame yet only keeps the newest one, the superseded frame is dropped on that output alone
+void X86DecCalculator::queue_avframe(const AVFrame* avframe)
+{
+	timestamp_t this_pts        = avframe->pts + pts_offset;
+	timestamp_t this_pts_now_us = get_now_us();
+	if (this_pts <= last_pts) {
+		timestamp_t pts_offset_change = ((this_pts_now_us - last_pts_now_us) / frame_distance_us) * frame_distance_us;
+		pts_offset += pts_offset_change;
+		this_pts += pts_offset_change;
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
+		                  AUP_AVAF_TERM_COLOR_FG_MAGENTA "PTS value dropped. Decoder will increase PTS offset "
+		                                                 "value accordingly" AUP_AVAF_TERM_FORMAT_RESET_ALL);
+	}
+	if (this_pts <= last_pts) {
+		timestamp_t pts_offset_change = last_pts - this_pts + frame_distance_us;
+		pts_offset += pts_offset_change;
+		this_pts += pts_offset_change;
+	}
+	last_pts        = this_pts;
+	last_pts_now_us = this_pts_now_us;
+
+	for (uint32_t i = 0; i < (uint32_t)pending_avframes.size(); i++) {
+		if (output_pending[i]) {
+			av_frame_unref(pending_avframes[i]);
+			output_drop_cnts[i]++;
+			AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+			                  __func__ << " " << node->output_streams[i].first << " stalled, dropped "
+			                           << output_drop_cnts[i] << " frames so far");
+		}
+		av_frame_ref(pending_avframes[i], avframe);
+		pending_ptss[i]   = this_pts;
+		output_pending[i] = true;
+	}
+}
+
+// sends the output's pending frame once its downstream pool has a free packet. Returns false while the pool is
+// full and the frame stays pending; with drop_packet_on_full_data_stream the frame is dropped instead and
+// counted in drop_cnt
+bool X86DecCalculator::output_avframe(uint32_t output_idx, uint32_t& drop_cnt)
+{
+	ErrorCode ec;
+	if (node->get_graph_status() != GraphStatus::RUNNING) {
+		av_frame_unref(pending_avframes[output_idx]);
+		output_pending[output_idx] = false;
+		return true;
+	}
+	auto img_packet = make_packet<ImagePacket>(pending_ptss[output_idx], false, image_allocators[output_idx], ec);
+	if (ec != ErrorCode::OK) {
+		if (!options->drop_packet_on_full_data_stream()) {
+			return false;
+		}
+		drop_cnt++;
+		output_drop_cnts[output_idx]++;
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+		                  __func__ << " " << node->output_streams[output_idx].first << " full, dropped "
+		                           << output_drop_cnts[output_idx] << " frames so far");
+	} else {
+		img_packet->set_pres_timestamp(pending_ptss[output_idx]);
+		if (!scale_avframe(pending_avframes[output_idx], output_idx, img_packet)) {
+			// the packet was never filled, releasing it hands the buffer back to the allocator
+			output_drop_cnts[output_idx]++;
 		} else {
-			av_frame_free(&recv_avframe);
-			break;
+			img_packet->set_fps(o_vid_stream_infos[output_idx]->fps);
+			if ((ec = node->enqueue(output_idx, img_packet)) != ErrorCode::OK) {
+				AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_ERROR,
+				                  "img_packet(pts:" << img_packet->get_pres_timestamp() << ") enqueue to "
+				                                    << node->output_streams[output_idx].first << " failed: " << ec);
+			}
+			AUP_AVAF_DBG("enqueue. sts:" << img_packet->get_sync_timestamp() << " now:" << get_now_us());
 		}
 	}
-	return ErrorCode::OK;
+	// hand the decoder's refcounted buffer back to its pool
+	av_frame_unref(pending_avframes[output_idx]);
+	output_pending[output_idx] = false;
+	return true;
+}
+
+// scales the decoded frame planes straight into the output image packet, see dec_scale_avframe. Returns false
+// when no scaler exists for the conversion and dst was left unfilled
+bool X86DecCalculator::scale_avframe(const AVFrame* src, uint32_t output_idx, PacketPtr<ImagePacket>& dst)
+{
+	AVFrame* dst_avframe = o_avframes[output_idx];
+	dst->get_ffmpeg_avframe(dst_avframe);
+	if (!dec_scale_avframe(src, dst_avframe, sws_ctxs[output_idx])) {
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_ERROR,
+		                  __func__ << " no scaler for output " << output_idx << " from "
+		                           << av_get_pix_fmt_name((AVPixelFormat)src->format));
+		return false;
+	}
+	return true;
 }
 
 ErrorCode X86DecCalculator::initialize(string& err_str)
@@ -194,17 +374,9 @@ ErrorCode X86DecCalculator::initialize(string& err_str)
 		return ErrorCode::ERROR;
 	}
 
-	AVCodecID codecId = AV_CODEC_ID_NONE;
-	switch (i_vid_stream_info->codec_type) {
-		case CODEC_TYPE_H264:
-			codecId = AV_CODEC_ID_H264;
-			break;
-		case CODEC_TYPE_H265:
-			codecId = AV_CODEC_ID_HEVC;
-			break;
-		default:
-			err_str = "X86 only support h264 or h265 decoder type";
-			return ErrorCode::ERROR;
+	AVCodecID codecId = dec_codec_id(*i_vid_stream_info, err_str);
+	if (codecId == AV_CODEC_ID_NONE) {
+		return ErrorCode::ERROR;
 	}
 
 	o_vid_stream_infos.resize(options->dec().ow_size());
@@ -237,25 +409,10 @@ ErrorCode X86DecCalculator::initialize(string& err_str)
 	                  "        low_latency = " << options->dec().low_latency());
 
 	// configure the context for x86 decoder
-	av_codec_ctx = avcodec_alloc_context3(NULL);
-	if (NULL == av_codec_ctx) {
-		err_str = "X86 decoder context allocate failed";
-		return ErrorCode::ERROR;
-	}
-	// set necessary field for decoder context
-	av_codec_ctx->framerate.num = floorf(i_vid_stream_info->fps);
-	av_codec_ctx->framerate.den = 1;
-	av_codec_ctx->width         = i_vid_stream_info->w;
-	av_codec_ctx->height        = i_vid_stream_info->h;
-	av_codec_ctx->time_base     = av_inv_q(av_codec_ctx->framerate);
-	// find the decoder and open it
-	const AVCodec* pCodec = avcodec_find_decoder(codecId);
-	if (NULL == pCodec) {
-		err_str = "Fail to find X86 decoder:" + string(avcodec_get_name(codecId));
+	if ((av_codec_ctx = dec_alloc_codec_ctx(*i_vid_stream_info, options->dec().low_latency(), err_str)) == NULL) {
 		return ErrorCode::ERROR;
 	}
-	if (avcodec_open2(av_codec_ctx, pCodec, NULL)) {
-		err_str = "Fail to open X86 decoder:" + string(avcodec_get_name(codecId));
+	if (!dec_open_codec(av_codec_ctx, codecId, err_str)) {
 		return ErrorCode::ERROR;
 	}
 
@@ -278,55 +435,42 @@ ErrorCode X86DecCalculator::initialize(string& err_str)
 		}
 	}
 
-	if ((int32_t)o_vid_stream_infos.size() > 0 && !multi_output_scaler_init()) {
-		err_str = "multi-output scaler initialize failed";
-		return ErrorCode::ERROR;
-	}
-	src_basic_image_packet_allocator =
-	    ImagePacket::Allocator::new_normal_allocator(av_codec_ctx->width, av_codec_ctx->height, PIXFMT_I420, 1, ec);
-	if (ec != ErrorCode::OK) {
-		err_str = "Issue creating src image allocator";
-		return ec;
-	}
-	src_basic_image_packet = make_packet<ImagePacket>(0, false, src_basic_image_packet_allocator, ec);
-	if (ec != ErrorCode::OK) {
-		err_str = "Issue creating src image";
-		return ec;
-	}
-
-	return ErrorCode::OK;
-}
-
-bool X86DecCalculator::multi_output_scaler_init()
-{
-	ErrorCode ec = ErrorCode::OK;
-	auto src_image_allocator =
-	    ImagePacket::Allocator::new_normal_allocator(av_codec_ctx->width, av_codec_ctx->height, PIXFMT_I420, 1, ec);
-	if (ec != ErrorCode::OK) {
-		return false;
-	}
-	auto src_img = make_packet<ImagePacket>(0, false, src_image_allocator, ec);
-	if (ec != ErrorCode::OK) {
-		return false;
-	}
-	vector<PacketPtr<ImagePacket>> dstVFrms;
-	for (uint32_t i = 0; i < (uint32_t)image_allocators.size(); i++) {
-		dstVFrms.emplace_back(make_packet<ImagePacket>(0, false, image_allocators.at(i), ec));
-		if (ec != ErrorCode::OK) {
-			return false;
+	o_avframes.resize(o_vid_stream_infos.size());
+	for (auto& o_avframe : o_avframes) {
+		if ((o_avframe = av_frame_alloc()) == NULL) {
+			err_str = "Issue allocating output av_frame";
+			return ErrorCode::NO_MEMORY;
 		}
 	}
-	{
-		cv::Size dims;
-		src_img->get_dims(dims);
-		for (auto& img : dstVFrms) {
-			img->get_dims(dims);
+	pending_avframes.resize(o_vid_stream_infos.size());
+	for (auto& pending_avframe : pending_avframes) {
+		if ((pending_avframe = av_frame_alloc()) == NULL) {
+			err_str = "Issue allocating pending av_frame";
+			return ErrorCode::NO_MEMORY;
 		}
 	}
-	if (multi_output_scaler.initialize(src_img, dstVFrms) != ErrorCode::OK) {
-		return false;
+	pending_ptss.resize(o_vid_stream_infos.size(), 0);
+	output_pending.resize(o_vid_stream_infos.size(), false);
+	sws_ctxs.resize(o_vid_stream_infos.size(), NULL);
+	output_drop_cnts.resize(o_vid_stream_infos.size(), 0);
+	if ((recv_avframe = av_frame_alloc()) == NULL) {
+		err_str = "Issue allocating decode av_frame";
+		return ErrorCode::NO_MEMORY;
 	}
-	return true;
+	for (int i = 0; i < DEC_FRAME_QUEUE_SIZE; i++) {
+		AVFrame* avframe = av_frame_alloc();
+		if (!avframe) {
+			err_str = "Issue allocating decode av_frame pool";
+			return ErrorCode::NO_MEMORY;
+		}
+		free_avframes.push(avframe);
+	}
+
+	running_         = true;
+	decode_thread_id = thread([&] { this->decode_thread(); });
+	output_thread_id = thread([&] { this->output_thread(); });
+
+	return ErrorCode::OK;
 }
 
 AUP_AVAF_REGISTER_CALCULATOR("Aupera", "x86_dec", X86DecCalculator, VideoCodecOptions,
@@ -1,9 +1,14 @@
 #pragma once
 
 // sdd header
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <semaphore.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <thread>
 #include <unistd.h>
 
 // sdk headers
@@ -13,6 +18,9 @@
 extern "C"
 {
 #include <libavcodec/avcodec.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
 }
 
 // avaf headers
@@ -20,10 +28,14 @@ extern "C"
 #include "aup/avaf/graph.h"
 #include "aup/avaf/node.h"
 #include "aup/avaf/packets/image_packet.h"
+#include "aup/avaf/packets/video_packet.h"
 #include "aup/avaf/packets/video_stream_info_packet.h"
 #include "aup/avaf/utils.h"
 #include "aup/avap/vcodec.pb.h"
 
+// local headers
+#include "dec_codec.h"
+
 using namespace std;
 using namespace aup::avaf;
 
@@ -31,10 +43,95 @@ using namespace aup::avaf;
 #define DEC_QUEUE_SIZE_DEFAULT 12
 #define DEC_QUEUE_SIZE_MAXIMUM 1000
 #define STREAM_INFO_WAIT_TIMEOUT 30'000'000
+#define DEC_PACKET_QUEUE_SIZE 32   // compressed packets buffered between execute and the decode thread
+#define DEC_FRAME_QUEUE_SIZE 4     // decoded frames buffered between the decode and output threads
+#define DEC_RESYNC_MAX_PACKETS 600 // gives up waiting for a key frame after a decode error, for streams without IDRs
+#define DEC_OUTPUT_RETRY_US 1000   // how long a full output waits before its image allocator is tried again
+
+// bounded FIFO whose push blocks while full and pop blocks while empty, close() releases both sides
+template <class T>
+class BoundedBlockingQueue
+{
+	deque<T> q;
+	mutex m;
+	condition_variable not_empty;
+	condition_variable not_full;
+	size_t capacity;
+	bool closed = false;
+
+public:
+	BoundedBlockingQueue(size_t capacity) : capacity(capacity) {}
+
+	bool push(T t)
+	{
+		unique_lock<mutex> lock(m);
+		not_full.wait(lock, [&] { return closed || q.size() < capacity; });
+		if (closed) {
+			return false;
+		}
+		q.push_back(std::move(t));
+		not_empty.notify_one();
+		return true;
+	}
+
+	bool pop(T& t)
+	{
+		unique_lock<mutex> lock(m);
+		not_empty.wait(lock, [&] { return closed || !q.empty(); });
+		if (q.empty()) {
+			return false;
+		}
+		t = std::move(q.front());
+		q.pop_front();
+		not_full.notify_one();
+		return true;
+	}
+
+	// like pop, but gives up and returns false after timeout
+	bool pop_for(T& t, chrono::microseconds timeout)
+	{
+		unique_lock<mutex> lock(m);
+		not_empty.wait_for(lock, timeout, [&] { return closed || !q.empty(); });
+		if (q.empty()) {
+			return false;
+		}
+		t = std::move(q.front());
+		q.pop_front();
+		not_full.notify_one();
+		return true;
+	}
+
+	// blocks until close() or timeout, false on timeout
+	bool wait_closed_for(chrono::microseconds timeout)
+	{
+		unique_lock<mutex> lock(m);
+		return not_empty.wait_for(lock, timeout, [&] { return closed; });
+	}
+
+	// leftover entries stay poppable so owners can release them
+	void close()
+	{
+		lock_guard<mutex> lock(m);
+		closed = true;
+		not_empty.notify_all();
+		not_full.notify_all();
+	}
+
+	size_t size()
+	{
+		lock_guard<mutex> lock(m);
+		return q.size();
+	}
+};
 
 class X86DecCalculator : public CalculatorBase<VideoCodecOptions>
 {
-	bool multi_output_scaler_init();
+	void decode_thread();
+	void output_thread();
+	void queue_avframe(const AVFrame* avframe);
+	bool output_avframe(uint32_t output_idx, uint32_t& drop_cnt);
+	bool scale_avframe(const AVFrame* src, uint32_t output_idx, PacketPtr<ImagePacket>& dst);
+	void start_resync(const string& reason);
 	PacketPtr<VideoStreamInfoPacket> i_vid_stream_info;
 	// The output image streams information after multiple-scaling
 	vector<PacketPtr<VideoStreamInfoPacket>> o_vid_stream_infos;
@@ -43,14 +140,38 @@ class X86DecCalculator : public CalculatorBase<VideoCodecOptions>
 	uint32_t send_vpacket_cnt    = 0;
 	uint32_t recv_img_packet_cnt = 0;
 	vector<shared_ptr<ImagePacket::Allocator>> image_allocators;
-	MultiOutputScaler multi_output_scaler;
+	vector<AVFrame*> o_avframes; // plane views of the output image packets being filled
+	vector<SwsContext*> sws_ctxs;
+	vector<uint64_t> output_drop_cnts;
+	// per output, the newest decoded frame it has no free image packet for yet
+	vector<AVFrame*> pending_avframes;
+	vector<timestamp_t> pending_ptss;
+	vector<bool> output_pending;
 	AVPacket send_vpacket;
-	PacketPtr<ImagePacket> src_basic_image_packet;
-	std::shared_ptr<ImagePacket::Allocator> src_basic_image_packet_allocator;
+	AVFrame* recv_avframe = NULL;
+	// execute -> decode thread -> output thread; free_avframes holds the spare frame shells, so decoded frames
+	// never outnumber DEC_FRAME_QUEUE_SIZE
+	BoundedBlockingQueue<PacketPtr<const VideoPacket>> vpacket_queue{DEC_PACKET_QUEUE_SIZE};
+	BoundedBlockingQueue<AVFrame*> decoded_avframes{DEC_FRAME_QUEUE_SIZE};
+	BoundedBlockingQueue<AVFrame*> free_avframes{DEC_FRAME_QUEUE_SIZE};
+	thread decode_thread_id;
+	thread output_thread_id;
+	atomic<bool> running_{false};
 	timestamp_t last_pts        = timestamp_min;
 	timestamp_t last_pts_now_us = timestamp_min;
 	timestamp_t pts_offset      = 0;
 	int frame_distance_us       = 0;
+	// set by the output thread while every output drops its frames, the decode thread then skips non-reference
+	// frames nobody has room for
+	atomic<bool> shedding_load{false};
+	uint32_t shed_cnt           = 0;
+	// after a decode error every frame up to the next clean key frame is dropped
+	bool resyncing              = false;
+	uint32_t resync_packet_cnt  = 0;
+	uint32_t resync_cnt         = 0;
+	uint32_t resync_drop_cnt    = 0;
+	uint32_t decode_error_cnt   = 0;
+	uint32_t corrupt_frame_cnt  = 0;
 
 protected:
 	ErrorCode fill_contract(shared_ptr<Contract>& contract, string& err_str) override;
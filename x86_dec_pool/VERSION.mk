@@ -0,0 +1,3 @@
+AUP_AVAF_CALC_VERSION_MAJOR=1
+AUP_AVAF_CALC_VERSION_MINOR=0
+AUP_AVAF_CALC_VERSION_PATCH=0
\ No newline at end of file
@@ -0,0 +1,286 @@
+// std headers
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sched.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// sdk headers (ffmpeg)
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+using namespace std;
+using namespace std::chrono;
+
+#define POOL_STREAM_QUEUE_SIZE 32 // x86_dec_pool's DEC_POOL_STREAM_QUEUE_SIZE
+
+struct BenchStream
+{
+	AVCodecContext* ctx = NULL;
+	AVFrame* frame      = NULL;
+	size_t next_packet  = 0;
+	uint64_t frame_cnt  = 0;
+	deque<pair<const AVPacket*, int64_t>> queue; // pooled run: queued packets with their arrival time, NULL flushes
+	bool busy = false;
+};
+
+static vector<AVPacket*> packets;
+static AVCodecParameters* codecpar = NULL;
+static int64_t frame_distance_us   = 40000;
+
+// reads every video packet of the input into memory so demuxing is not part of the measurement
+static bool load_packets(const string& input)
+{
+	AVFormatContext* fmt_ctx = NULL;
+	if (avformat_open_input(&fmt_ctx, input.c_str(), NULL, NULL) || avformat_find_stream_info(fmt_ctx, NULL) < 0) {
+		cerr << "cannot open " << input << endl;
+		return false;
+	}
+	int v_stream_idx = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+	if (v_stream_idx < 0) {
+		cerr << "no video stream in " << input << endl;
+		avformat_close_input(&fmt_ctx);
+		return false;
+	}
+	codecpar = avcodec_parameters_alloc();
+	avcodec_parameters_copy(codecpar, fmt_ctx->streams[v_stream_idx]->codecpar);
+	AVRational frame_rate = fmt_ctx->streams[v_stream_idx]->avg_frame_rate;
+	if (frame_rate.num && frame_rate.den) {
+		frame_distance_us = 1000000LL * frame_rate.den / frame_rate.num;
+	}
+	AVPacket* pkt = av_packet_alloc();
+	while (av_read_frame(fmt_ctx, pkt) >= 0) {
+		if (pkt->stream_index == v_stream_idx) {
+			packets.push_back(av_packet_clone(pkt));
+		}
+		av_packet_unref(pkt);
+	}
+	av_packet_free(&pkt);
+	avformat_close_input(&fmt_ctx);
+	return true;
+}
+
+// a single threaded decoder, the way both x86_dec and x86_dec_pool open theirs
+static bool open_stream(BenchStream& stream)
+{
+	const AVCodec* pCodec = avcodec_find_decoder(codecpar->codec_id);
+	stream.ctx            = avcodec_alloc_context3(pCodec);
+	avcodec_parameters_to_context(stream.ctx, codecpar);
+	stream.ctx->thread_count = 1;
+	stream.frame             = av_frame_alloc();
+	return !avcodec_open2(stream.ctx, pCodec, NULL);
+}
+
+static void close_stream(BenchStream& stream)
+{
+	av_frame_free(&stream.frame);
+	avcodec_free_context(&stream.ctx);
+}
+
+// sends one packet, NULL flushes, and drains the decoder
+static void decode_packet(BenchStream& stream, const AVPacket* pkt)
+{
+	avcodec_send_packet(stream.ctx, pkt);
+	while (!avcodec_receive_frame(stream.ctx, stream.frame)) {
+		stream.frame_cnt++;
+		av_frame_unref(stream.frame);
+	}
+}
+
+// sends the next packet (or the flush packet after the last one), false once fully drained
+static bool decode_next(BenchStream& stream)
+{
+	if (stream.next_packet > packets.size()) {
+		return false;
+	}
+	decode_packet(stream, stream.next_packet < packets.size() ? packets[stream.next_packet] : NULL);
+	stream.next_packet++;
+	return true;
+}
+
+// x86_dec_pool's next_stream, with the lock held: a packet is due one frame interval after it arrived and every
+// packet queued behind it pulls the deadline one more frame earlier, the idle stream with the earliest one goes first
+static BenchStream* next_stream(vector<BenchStream>& streams)
+{
+	BenchStream* next     = NULL;
+	int64_t next_deadline = 0;
+	for (auto& stream : streams) {
+		if (stream.busy || stream.queue.empty()) {
+			continue;
+		}
+		int64_t deadline = stream.queue.front().second + frame_distance_us -
+		                   (int64_t)(stream.queue.size() - 1) * frame_distance_us;
+		if (!next || deadline < next_deadline) {
+			next          = &stream;
+			next_deadline = deadline;
+		}
+	}
+	return next;
+}
+
+static int64_t now_us()
+{
+	return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void report(const char* name, vector<BenchStream>& streams, int thread_cnt, steady_clock::time_point start,
+                   clock_t cpu_start)
+{
+	double elapsed_s = duration<double>(steady_clock::now() - start).count();
+	double cpu_s     = (double)(clock() - cpu_start) / CLOCKS_PER_SEC;
+	uint64_t frames  = 0;
+	for (auto& stream : streams) {
+		frames += stream.frame_cnt;
+	}
+	cout << left << setw(12) << name << " streams:" << streams.size() << " threads:" << thread_cnt
+	     << " frames:" << frames << " fps:" << fixed << setprecision(1) << frames / elapsed_s
+	     << " frames_per_cpu_s:" << frames / cpu_s << endl;
+}
+
+// one decoder per stream on its own thread, what N x86_dec nodes run
+static void run_independent(int stream_cnt)
+{
+	vector<BenchStream> streams(stream_cnt);
+	for (auto& stream : streams) {
+		open_stream(stream);
+	}
+	auto start        = steady_clock::now();
+	clock_t cpu_start = clock();
+	vector<thread> threads;
+	for (auto& stream : streams) {
+		threads.emplace_back([&stream] {
+			while (decode_next(stream)) {
+			}
+		});
+	}
+	for (auto& t : threads) {
+		t.join();
+	}
+	report("independent", streams, stream_cnt, start, cpu_start);
+	for (auto& stream : streams) {
+		close_stream(stream);
+	}
+}
+
+// single threaded decoders served by a fixed worker pool the way x86_dec_pool schedules them: this thread stands
+// in for execute and queues every stream's packets with their arrival time, an idle worker takes the stream with
+// the earliest deadline or sleeps on the condition variable. Unlike the node, a full stream queue is skipped and
+// fed again later instead of dropping up to the next key frame, so every stream decodes the whole file
+static void run_pooled(int stream_cnt, int worker_cnt)
+{
+	vector<BenchStream> streams(stream_cnt);
+	for (auto& stream : streams) {
+		open_stream(stream);
+	}
+	mutex m;
+	condition_variable work_ready;  // a stream got a packet or was released by a worker
+	condition_variable queue_space; // a packet left a stream queue
+	bool feeding      = true;
+	auto start        = steady_clock::now();
+	clock_t cpu_start = clock();
+	vector<thread> workers;
+	for (int i = 0; i < worker_cnt; i++) {
+		workers.emplace_back([&] {
+			unique_lock<mutex> lock(m);
+			while (true) {
+				BenchStream* stream = next_stream(streams);
+				if (!stream) {
+					bool queued = false;
+					for (auto& s : streams) {
+						queued |= !s.queue.empty();
+					}
+					if (!feeding && !queued) {
+						return;
+					}
+					work_ready.wait(lock);
+					continue;
+				}
+				const AVPacket* pkt = stream->queue.front().first;
+				stream->queue.pop_front();
+				stream->busy = true;
+				queue_space.notify_one();
+				lock.unlock();
+
+				decode_packet(*stream, pkt);
+
+				lock.lock();
+				stream->busy = false;
+				if (!stream->queue.empty()) {
+					work_ready.notify_one();
+				}
+			}
+		});
+	}
+
+	unique_lock<mutex> lock(m);
+	while (true) {
+		bool fed = false, left = false;
+		for (auto& stream : streams) {
+			if (stream.next_packet > packets.size()) {
+				continue;
+			}
+			left = true;
+			if (stream.queue.size() >= POOL_STREAM_QUEUE_SIZE) {
+				continue;
+			}
+			const AVPacket* pkt = stream.next_packet < packets.size() ? packets[stream.next_packet] : NULL;
+			stream.queue.emplace_back(pkt, now_us());
+			stream.next_packet++;
+			fed = true;
+			work_ready.notify_one();
+		}
+		if (!left) {
+			break;
+		}
+		if (!fed) {
+			queue_space.wait(lock);
+		}
+	}
+	feeding = false;
+	work_ready.notify_all();
+	lock.unlock();
+	for (auto& t : workers) {
+		t.join();
+	}
+	report("pooled", streams, worker_cnt, start, cpu_start);
+	for (auto& stream : streams) {
+		close_stream(stream);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3) {
+		cerr << "usage: " << argv[0] << " <video file> <stream count> [pool workers, 0 = one per usable core]"
+		     << endl;
+		return 1;
+	}
+	int stream_cnt = stoi(argv[2]);
+	int worker_cnt = argc > 3 ? stoi(argv[3]) : 0;
+	if (!worker_cnt) {
+		// x86_dec_pool's worker count, taken from the cpu affinity so taskset limits it
+		cpu_set_t cpus;
+		worker_cnt = sched_getaffinity(0, sizeof(cpus), &cpus) ? thread::hardware_concurrency() : CPU_COUNT(&cpus);
+		worker_cnt = max(worker_cnt, 1);
+	}
+	worker_cnt = min(worker_cnt, stream_cnt);
+	if (!load_packets(argv[1])) {
+		return 1;
+	}
+	run_independent(stream_cnt);
+	run_pooled(stream_cnt, worker_cnt);
+	for (auto& pkt : packets) {
+		av_packet_free(&pkt);
+	}
+	avcodec_parameters_free(&codecpar);
+	return 0;
+}
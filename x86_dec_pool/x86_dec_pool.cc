@@ -0,0 +1,416 @@
+// declaration headers
+#include "x86_dec_pool.h"
+
+// std headres
+#include <chrono>
+
+// avaf headres
+#include "aup/avaf/thread_name.h"
+
+// #define AUP_AVAF_DBG_ENABLE (1)
+#include "aup/avaf/avaf_dbg.h"
+
+using namespace std::chrono;
+
+DecPoolStream::~DecPoolStream()
+{
+	sws_freeContext(sws_ctx);
+	if (send_vpacket) {
+		av_packet_free(&send_vpacket);
+	}
+	if (o_avframe) {
+		av_frame_free(&o_avframe);
+	}
+	if (recv_avframe) {
+		av_frame_free(&recv_avframe);
+	}
+	if (av_codec_ctx) {
+		avcodec_free_context(&av_codec_ctx);
+	}
+}
+
+X86DecPoolCalculator::~X86DecPoolCalculator()
+{
+	{
+		lock_guard<mutex> lock(m);
+		running_ = false;
+		work_ready.notify_all();
+	}
+	for (auto& worker : worker_threads) {
+		AUP_AVAF_THREAD_JOIN_NOTERM(worker);
+	}
+	for (auto& stream : streams) {
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+		                  __func__ << " stream " << stream->idx << " decoded " << stream->decoded_frame_cnt
+		                           << " frames, dropped " << stream->dropped_frame_cnt << " frames and "
+		                           << stream->dropped_vpacket_cnt << " vpackets");
+		if (stream->resync_cnt) {
+			AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+			                  __func__ << " stream " << stream->idx << " " << stream->decode_error_cnt
+			                           << " decode errors, " << stream->corrupt_frame_cnt << " corrupt frames, "
+			                           << stream->resync_cnt << " resyncs dropped " << stream->resync_drop_cnt
+			                           << " frames");
+		}
+	}
+}
+
+// inputs: N video packet streams followed by their N video stream info side packets
+// outputs: N image streams followed by their N video stream info side packets
+ErrorCode X86DecPoolCalculator::fill_contract(shared_ptr<Contract>& contract, string& err_str)
+{
+	auto sz = contract->input_stream_names.size();
+	if (sz < 2 || sz % 2 != 0 || contract->output_stream_names.size() != sz) {
+		err_str = "node must have a positive even number of inputs and as many outputs";
+		return ErrorCode::INVALID_CONTRACT;
+	}
+	if (options->dec().ow_size() != 1 && options->dec().ow_size() != (int)sz / 2) {
+		err_str = "output width, height and pixfmt must be given once or once per stream";
+		return ErrorCode::INVALID_CONTRACT;
+	}
+	auto video_stream_info_packet = make_packet<VideoStreamInfoPacket>();
+	auto image_packet             = make_packet<ImagePacket>();
+	for (int i = 0; i < (int)sz / 2; i++) {
+		contract->sample_input_packets[i]          = make_packet<VideoPacket>();
+		contract->sample_input_packets[i + sz / 2] = video_stream_info_packet;
+		contract->input_attrs_arr[i + sz / 2].set_type(GraphConfig::Node::InputStreamAttributes::SIDE_PACKET);
+		contract->sample_output_packets[i]          = image_packet;
+		contract->sample_output_packets[i + sz / 2] = video_stream_info_packet;
+	}
+	return ErrorCode::OK;
+}
+
+// only queues the packets for the workers and never blocks: a stream the workers are DEC_POOL_STREAM_QUEUE_SIZE
+// packets behind on drops its packet and everything up to its next key frame, so one stalled stream never holds
+// up the graph thread and with it every other stream
+ErrorCode X86DecPoolCalculator::execute()
+{
+	for (auto& stream : streams) {
+		PacketPtr<const VideoPacket> vpacket = nullptr;
+		if (node->get_packet(stream->idx, vpacket) != ErrorCode::OK) {
+			continue;
+		}
+		AUP_AVAF_DBG("dequeue. stream:" << stream->idx << " sts:" << vpacket->get_sync_timestamp());
+		lock_guard<mutex> lock(m);
+		if (stream->wait_key_frame && vpacket->picType != PicType::I) {
+			stream->dropped_vpacket_cnt++;
+			continue;
+		}
+		stream->wait_key_frame = stream->vpackets.size() >= DEC_POOL_STREAM_QUEUE_SIZE;
+		if (stream->wait_key_frame) {
+			stream->dropped_vpacket_cnt++;
+			AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
+			                  __func__ << " stream " << stream->idx
+			                           << " queue full, dropping packets up to the next key frame");
+			continue;
+		}
+		stream->vpackets.emplace_back(vpacket, get_now_us());
+		work_ready.notify_one();
+	}
+	return ErrorCode::OK;
+}
+
+// picks the idle stream with the earliest deadline, with m held; a packet is due one frame interval after it
+// arrived and every packet queued behind it pulls the deadline one more frame earlier, so deep queues catch up.
+// A stream with a pending frame is only eligible from its retry time on, the earliest such time goes to wake_us
+DecPoolStream* X86DecPoolCalculator::next_stream(timestamp_t now, timestamp_t& wake_us)
+{
+	DecPoolStream* next       = NULL;
+	timestamp_t next_deadline = timestamp_max;
+	for (auto& stream : streams) {
+		if (stream->busy) {
+			continue;
+		}
+		timestamp_t deadline;
+		if (stream->frame_pending) {
+			if (stream->retry_us > now) {
+				wake_us = std::min(wake_us, stream->retry_us);
+				continue;
+			}
+			deadline = stream->retry_us;
+		} else if (stream->vpackets.empty()) {
+			continue;
+		} else {
+			deadline = stream->vpackets.front().second + stream->frame_distance_us -
+			           (timestamp_t)(stream->vpackets.size() - 1) * stream->frame_distance_us;
+		}
+		if (!next || deadline < next_deadline) {
+			next          = stream.get();
+			next_deadline = deadline;
+		}
+	}
+	return next;
+}
+
+void X86DecPoolCalculator::worker_thread()
+{
+	AUP_AVAF_HANDLE_THREAD_NAME();
+	unique_lock<mutex> lock(m);
+	while (running_) {
+		timestamp_t now       = get_now_us();
+		timestamp_t wake_us   = timestamp_max;
+		DecPoolStream* stream = next_stream(now, wake_us);
+		if (!stream) {
+			if (wake_us == timestamp_max) {
+				work_ready.wait(lock);
+			} else {
+				work_ready.wait_for(lock, microseconds(wake_us - now));
+			}
+			continue;
+		}
+		// a pending frame goes out before the decoder is fed again
+		PacketPtr<const VideoPacket> vpacket = nullptr;
+		if (!stream->frame_pending) {
+			vpacket = stream->vpackets.front().first;
+			stream->vpackets.pop_front();
+		}
+		stream->busy = true;
+		lock.unlock();
+
+		bool output_done = vpacket ? decode_vpacket(*stream, vpacket) : receive_frames(*stream);
+		vpacket          = nullptr;
+
+		lock.lock();
+		stream->busy = false;
+		if (!output_done) {
+			stream->retry_us = get_now_us() + DEC_POOL_OUTPUT_RETRY_US;
+		} else if (!stream->vpackets.empty()) {
+			work_ready.notify_one();
+		}
+	}
+}
+
+// false when a decoded frame is left pending for lack of an image packet
+bool X86DecPoolCalculator::decode_vpacket(DecPoolStream& stream, PacketPtr<const VideoPacket>& vpacket)
+{
+	AVPacket* send_vpacket = stream.send_vpacket;
+	send_vpacket->pts      = vpacket->get_pres_timestamp();
+	send_vpacket->dts      = vpacket->dts;
+	send_vpacket->size     = vpacket->len;
+	send_vpacket->data     = vpacket->pBuf;
+	send_vpacket->pos      = -1;
+	if (stream.resyncing && ++stream.resync_packet_cnt > DEC_RESYNC_MAX_PACKETS) {
+		stream.resyncing = false;
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
+		                  __func__ << " stream " << stream.idx << " no key frame within " << DEC_RESYNC_MAX_PACKETS
+		                           << " packets after a decode error, resuming on any frame");
+	}
+	// nothing before the next key frame is output, so the decoder does not need to reconstruct it
+	stream.av_codec_ctx->skip_frame = stream.resyncing ? AVDISCARD_NONKEY : AVDISCARD_DEFAULT;
+	int ret                         = avcodec_send_packet(stream.av_codec_ctx, send_vpacket);
+	if (ret < 0 && ret != AVERROR(EAGAIN)) {
+		stream.decode_error_cnt++;
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_ERROR,
+		                  __func__ << " stream " << stream.idx << " send vpkt failed, len:" << send_vpacket->size
+		                           << ", pts:" << send_vpacket->pts << ", error:" << ret);
+		start_resync(stream, "send packet failed");
+	}
+	av_packet_unref(send_vpacket);
+	return receive_frames(stream);
+}
+
+// drops everything up to the next clean key frame of the stream, see X86DecCalculator::start_resync
+void X86DecPoolCalculator::start_resync(DecPoolStream& stream, const string& reason)
+{
+	if (stream.resyncing) {
+		return;
+	}
+	stream.resyncing         = true;
+	stream.resync_packet_cnt = 0;
+	stream.resync_cnt++;
+	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
+	                  __func__ << " stream " << stream.idx << " " << reason
+	                           << ", dropping frames until the next key frame");
+}
+
+// outputs the pending frame, then every frame the decoder has ready; returns false with the frame left pending
+// when the image allocator is full, so the worker moves on instead of polling the allocator
+bool X86DecPoolCalculator::receive_frames(DecPoolStream& stream)
+{
+	while (running_) {
+		if (!stream.frame_pending) {
+			int ret = avcodec_receive_frame(stream.av_codec_ctx, stream.recv_avframe);
+			if (ret) {
+				if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+					stream.decode_error_cnt++;
+					AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_ERROR,
+					                  __func__ << " stream " << stream.idx << " recv frame failed, error:" << ret);
+					start_resync(stream, "receive frame failed");
+				}
+				return true;
+			}
+			stream.decoded_frame_cnt++;
+			bool corrupt = DEC_AVFRAME_IS_CORRUPT(stream.recv_avframe);
+			if (corrupt) {
+				stream.corrupt_frame_cnt++;
+				start_resync(stream, "corrupt frame");
+			}
+			if (stream.resyncing) {
+				if (corrupt || !DEC_AVFRAME_IS_KEY(stream.recv_avframe)) {
+					stream.resync_drop_cnt++;
+					av_frame_unref(stream.recv_avframe);
+					continue;
+				}
+				stream.resyncing = false;
+				AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
+				                  __func__ << " stream " << stream.idx << " resynced on key frame, pts:"
+				                           << stream.recv_avframe->pts << ", " << stream.resync_drop_cnt
+				                           << " frames dropped so far");
+			}
+			stream.frame_pending = true;
+		}
+		if (!output_avframe(stream)) {
+			return false;
+		}
+		stream.frame_pending = false;
+		av_frame_unref(stream.recv_avframe);
+	}
+	return true;
+}
+
+// false when no image packet is free and the frame has to wait
+bool X86DecPoolCalculator::output_avframe(DecPoolStream& stream)
+{
+	const AVFrame* src = stream.recv_avframe;
+	timestamp_t pts    = src->pts;
+	if (pts <= stream.last_pts) {
+		pts = stream.last_pts + stream.frame_distance_us;
+	}
+
+	ErrorCode ec;
+	PacketPtr<ImagePacket> img_packet = make_packet<ImagePacket>(pts, false, stream.image_allocator, ec);
+	if (ec != ErrorCode::OK) {
+		if (!options->drop_packet_on_full_data_stream() && node->get_graph_status() == GraphStatus::RUNNING) {
+			return false;
+		}
+		stream.dropped_frame_cnt++;
+		return true;
+	}
+	stream.last_pts = pts;
+	img_packet->set_pres_timestamp(pts);
+
+	img_packet->get_ffmpeg_avframe(stream.o_avframe);
+	if (!dec_scale_avframe(src, stream.o_avframe, stream.sws_ctx)) {
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_ERROR,
+		                  __func__ << " no scaler for stream " << stream.idx << " from "
+		                           << av_get_pix_fmt_name((AVPixelFormat)src->format));
+		stream.dropped_frame_cnt++;
+		return true;
+	}
+	img_packet->set_fps(stream.o_vid_stream_info->fps);
+	if ((ec = node->enqueue(stream.idx, img_packet)) != ErrorCode::OK) {
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_ERROR,
+		                  "img_packet(pts:" << img_packet->get_pres_timestamp() << ") enqueue to "
+		                                    << node->output_streams[stream.idx].first << " failed: " << ec);
+	}
+	AUP_AVAF_DBG("enqueue. stream:" << stream.idx << " sts:" << img_packet->get_sync_timestamp());
+	return true;
+}
+
+ErrorCode X86DecPoolCalculator::open_stream(DecPoolStream& stream, int queue_sz, string& err_str)
+{
+	uint32_t stream_cnt = streams.size();
+	auto ec             = node->dequeue_block(stream_cnt + stream.idx, stream.i_vid_stream_info);
+	if (ec != ErrorCode::OK) {
+		err_str = "Could not dequeue side packet of stream " + to_string(stream.idx);
+		return ec;
+	}
+	auto& info = stream.i_vid_stream_info;
+	if (!info->w || !info->h) {
+		err_str = "Fail to receive video stream info of stream " + to_string(stream.idx);
+		return ErrorCode::ERROR;
+	}
+	stream.frame_distance_us = (int)(1'000'000.f / info->fps);
+
+	AVCodecID codecId = dec_codec_id(*info, err_str);
+	if (codecId == AV_CODEC_ID_NONE) {
+		return ErrorCode::ERROR;
+	}
+
+	int opt_idx                      = options->dec().ow_size() == 1 ? 0 : stream.idx;
+	stream.o_vid_stream_info         = make_packet<VideoStreamInfoPacket>(*info.get());
+	stream.o_vid_stream_info->w      = options->dec().ow()[opt_idx] ?: info->w;
+	stream.o_vid_stream_info->h      = options->dec().oh()[opt_idx] ?: info->h;
+	stream.o_vid_stream_info->pixfmt = options->dec().opixfmt()[opt_idx]
+	                                       ? static_cast<PixFmt>(options->dec().opixfmt()[opt_idx])
+	                                       : info->pixfmt;
+	if ((ec = node->enqueue(stream_cnt + stream.idx, stream.o_vid_stream_info)) != ErrorCode::OK) {
+		err_str = "Failure sending side packet " + to_string(stream.idx);
+		return ec;
+	}
+
+	if ((stream.av_codec_ctx = dec_alloc_codec_ctx(*info, options->dec().low_latency(), err_str)) == NULL) {
+		return ErrorCode::ERROR;
+	}
+	// the worker pool is the parallelism, a per-stream thread set is what oversubscribes the cores
+	stream.av_codec_ctx->thread_count = 1;
+	if (!dec_open_codec(stream.av_codec_ctx, codecId, err_str)) {
+		return ErrorCode::ERROR;
+	}
+
+	stream.image_allocator = ImagePacket::Allocator::new_normal_allocator(
+	    stream.o_vid_stream_info->w, stream.o_vid_stream_info->h, stream.o_vid_stream_info->pixfmt, queue_sz, ec);
+	if (ec != ErrorCode::OK) {
+		err_str = "frame allocator initialize failed.";
+		return ErrorCode::ERROR;
+	}
+	if ((stream.recv_avframe = av_frame_alloc()) == NULL || (stream.o_avframe = av_frame_alloc()) == NULL ||
+	    (stream.send_vpacket = av_packet_alloc()) == NULL) {
+		err_str = "Issue allocating av_frame/av_packet";
+		return ErrorCode::NO_MEMORY;
+	}
+
+	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+	                  __func__ << " stream " << stream.idx << ": " << avcodec_get_name(codecId) << " " << info->w
+	                           << "x" << info->h << "@" << info->fps << " -> " << stream.o_vid_stream_info->w << "x"
+	                           << stream.o_vid_stream_info->h << " pixfmt " << stream.o_vid_stream_info->pixfmt);
+	return ErrorCode::OK;
+}
+
+ErrorCode X86DecPoolCalculator::initialize(string& err_str)
+{
+	uint32_t stream_cnt = node->input_streams.size() / 2;
+	if ((uint32_t)node->output_streams.size() != stream_cnt * 2) {
+		err_str = "Output stream count not match with node required";
+		return ErrorCode::ERROR;
+	}
+	if (options->dec().oh_size() != options->dec().ow_size() ||
+	    options->dec().opixfmt_size() != options->dec().ow_size()) {
+		err_str = "Output width and height and pixfmt vector size not the same.";
+		return ErrorCode::ERROR;
+	}
+
+	int queue_sz = (options->dec().queue_size() > 0) ? options->dec().queue_size() : DEC_QUEUE_SIZE_DEFAULT;
+	if (queue_sz > DEC_QUEUE_SIZE_MAXIMUM) {
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
+		                  __func__ << " decode queue size auto modify to max allowed value:" << DEC_QUEUE_SIZE_MAXIMUM);
+		queue_sz = DEC_QUEUE_SIZE_MAXIMUM;
+	}
+
+	for (uint32_t i = 0; i < stream_cnt; i++) {
+		streams.emplace_back(make_unique<DecPoolStream>());
+		streams.back()->idx = i;
+	}
+	for (auto& stream : streams) {
+		auto ec = open_stream(*stream, queue_sz, err_str);
+		if (ec != ErrorCode::OK) {
+			return ec;
+		}
+	}
+
+	// one worker per core the process may run on, so a taskset or cpuset limit sizes the pool at launch
+	cpu_set_t cpus;
+	uint32_t core_cnt   = sched_getaffinity(0, sizeof(cpus), &cpus) ? thread::hardware_concurrency() : CPU_COUNT(&cpus);
+	uint32_t worker_cnt = std::min(std::max(core_cnt, 1u), stream_cnt);
+	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+	                  __func__ << " decoding " << stream_cnt << " streams on " << worker_cnt << " workers, "
+	                           << core_cnt << " usable cores");
+
+	running_ = true;
+	for (uint32_t i = 0; i < worker_cnt; i++) {
+		worker_threads.emplace_back([&] { this->worker_thread(); });
+	}
+	return ErrorCode::OK;
+}
+
+AUP_AVAF_REGISTER_CALCULATOR("Aupera", "x86_dec_pool", X86DecPoolCalculator, VideoCodecOptions,
+                             "Aupera's pooled multi-stream x86 decoder calculator.", {})
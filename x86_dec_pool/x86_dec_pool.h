@@ -0,0 +1,104 @@
+#pragma once
+
+// std headers
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <sched.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <thread>
+#include <unistd.h>
+
+// sdk headers
+#include <boost/log/common.hpp>
+
+// sdk headers (ffmpeg)
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+// avaf headers
+#include "aup/avaf/calculator.h"
+#include "aup/avaf/graph.h"
+#include "aup/avaf/node.h"
+#include "aup/avaf/packets/image_packet.h"
+#include "aup/avaf/packets/video_packet.h"
+#include "aup/avaf/packets/video_stream_info_packet.h"
+#include "aup/avaf/utils.h"
+#include "aup/avap/vcodec.pb.h"
+
+// local headers
+#include "../x86_dec/dec_codec.h"
+
+using namespace std;
+using namespace aup::avaf;
+
+#define DEC_QUEUE_SIZE_DEFAULT 12
+#define DEC_QUEUE_SIZE_MAXIMUM 1000
+#define DEC_POOL_STREAM_QUEUE_SIZE 32  // packets buffered per stream, a full queue drops up to the next key frame
+#define DEC_POOL_OUTPUT_RETRY_US 1000  // a stream whose image allocator ran out is retried after this long
+#define DEC_RESYNC_MAX_PACKETS 600     // packets waited for a key frame after a decode error, for streams without IDRs
+
+// decoding state of one input stream; a stream is decoded by at most one worker at a time, so its codec
+// context runs single threaded and its frames leave in order
+struct DecPoolStream
+{
+	uint32_t idx = 0;
+	PacketPtr<VideoStreamInfoPacket> i_vid_stream_info;
+	PacketPtr<VideoStreamInfoPacket> o_vid_stream_info;
+	AVCodecContext* av_codec_ctx = NULL;
+	AVPacket* send_vpacket       = NULL;
+	AVFrame* recv_avframe        = NULL;
+	AVFrame* o_avframe           = NULL; // plane view of the output image packet being filled
+	SwsContext* sws_ctx          = NULL;
+	shared_ptr<ImagePacket::Allocator> image_allocator;
+	deque<pair<PacketPtr<const VideoPacket>, timestamp_t>> vpackets; // queued packets with their arrival time
+	bool busy                    = false;
+	bool wait_key_frame          = false; // the queue overflowed, packets are dropped up to the next key frame
+	bool frame_pending           = false; // recv_avframe holds a decoded frame that found no free image packet
+	timestamp_t retry_us         = 0;     // when a pending frame is tried again
+	// after a decode error every frame up to the next clean key frame is dropped
+	bool resyncing               = false;
+	uint32_t resync_packet_cnt   = 0;
+	uint32_t resync_cnt          = 0;
+	uint32_t resync_drop_cnt     = 0;
+	uint32_t decode_error_cnt    = 0;
+	uint32_t corrupt_frame_cnt   = 0;
+	int frame_distance_us        = 0;
+	timestamp_t last_pts         = timestamp_min;
+	uint64_t decoded_frame_cnt   = 0;
+	uint64_t dropped_frame_cnt   = 0;
+	uint64_t dropped_vpacket_cnt = 0;
+
+	~DecPoolStream();
+};
+
+class X86DecPoolCalculator : public CalculatorBase<VideoCodecOptions>
+{
+	ErrorCode open_stream(DecPoolStream& stream, int queue_sz, string& err_str);
+	DecPoolStream* next_stream(timestamp_t now, timestamp_t& wake_us);
+	void worker_thread();
+	bool decode_vpacket(DecPoolStream& stream, PacketPtr<const VideoPacket>& vpacket);
+	bool receive_frames(DecPoolStream& stream);
+	bool output_avframe(DecPoolStream& stream);
+	void start_resync(DecPoolStream& stream, const string& reason);
+	vector<unique_ptr<DecPoolStream>> streams;
+	mutex m;
+	condition_variable work_ready; // a stream got a packet or was released by a worker
+	vector<thread> worker_threads;
+	atomic<bool> running_{false};
+
+protected:
+	ErrorCode fill_contract(shared_ptr<Contract>& contract, string& err_str) override;
+
+public:
+	X86DecPoolCalculator(const Node* node) : CalculatorBase(node) { ffmpeg_init(); }
+	virtual ~X86DecPoolCalculator();
+	ErrorCode initialize(string& err_str) override;
+	ErrorCode execute() override;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+// std headers
+#include <array>
+#include <stdint.h>
+
+// fixed capacity map from the pts of the frames sent to an encoder to their sync timestamps, kept in send order.
+// Packets come back in coding order, which only differs from send order inside the encoder's reorder window, so a
+// lookup scans a few slots from the oldest pending frame; nothing is allocated after construction
+template <size_t N>
+class PtsRing
+{
+	struct Entry
+	{
+		int64_t pts  = 0;
+		int64_t sts  = 0;
+		bool pending = false;
+	};
+	std::array<Entry, N> entries;
+	uint64_t head = 0; // next slot to write
+	uint64_t tail = 0; // oldest slot still pending
+
+public:
+	// returns false when the oldest pending frame had to be overwritten, i.e. the encoder delay exceeds N frames
+	bool push(int64_t pts, int64_t sts)
+	{
+		bool overflow = head - tail == N;
+		if (overflow) {
+			tail++;
+		}
+		entries[head % N] = {pts, sts, true};
+		head++;
+		return !overflow;
+	}
+
+	bool pop(int64_t pts, int64_t& sts)
+	{
+		for (uint64_t i = tail; i < head; i++) {
+			Entry& entry = entries[i % N];
+			if (entry.pending && entry.pts == pts) {
+				sts           = entry.sts;
+				entry.pending = false;
+				while (tail < head && !entries[tail % N].pending) {
+					tail++;
+				}
+				return true;
+			}
+		}
+		return false;
+	}
+
+	size_t size() const { return head - tail; }
+};
@@ -0,0 +1,196 @@
+// std headers
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// sdk headers (ffmpeg)
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+using namespace std;
+using namespace std::chrono;
+
+#define POOL_SIZE 12 // image packets an ff_vfilter node would cycle through
+
+static AVFrame* alloc_frame(AVPixelFormat fmt, int w, int h)
+{
+	AVFrame* frame = av_frame_alloc();
+	frame->format  = fmt;
+	frame->width   = w;
+	frame->height  = h;
+	av_frame_get_buffer(frame, 0);
+	return frame;
+}
+
+// moving gradient in every plane byte, enough texture and motion for the encoder to do real work
+static void fill_frame(AVFrame* frame, int idx)
+{
+	for (int p = 0; p < AV_NUM_DATA_POINTERS && frame->data[p]; p++) {
+		int rows = (p && frame->format != AV_PIX_FMT_BGR24) ? frame->height / 2 : frame->height;
+		for (int y = 0; y < rows; y++) {
+			uint8_t* row = frame->data[p] + y * frame->linesize[p];
+			for (int x = 0; x < frame->linesize[p]; x++) {
+				row[x] = (uint8_t)(x + y * 3 + idx * 5 + p * 40);
+			}
+		}
+	}
+}
+
+static AVCodecContext* open_encoder(AVPixelFormat fmt, int w, int h)
+{
+	const AVCodec* pCodec = avcodec_find_encoder(AV_CODEC_ID_H264);
+	AVCodecContext* ctx   = avcodec_alloc_context3(pCodec);
+	ctx->width            = w;
+	ctx->height           = h;
+	ctx->pix_fmt          = fmt;
+	ctx->framerate        = {30, 1};
+	ctx->time_base        = {1, 30};
+	av_opt_set(ctx->priv_data, "preset", "veryfast", 0);
+	if (avcodec_open2(ctx, pCodec, NULL)) {
+		avcodec_free_context(&ctx);
+	}
+	return ctx;
+}
+
+// the frame as x86_enc sees an image packet through get_ffmpeg_avframe: plane pointers without a buffer
+// reference, so avcodec_send_frame copies the picture into a refcounted frame first
+static AVFrame* as_packet_view(const AVFrame* src, AVFrame* view)
+{
+	av_frame_unref(view);
+	view->format = src->format;
+	view->width  = src->width;
+	view->height = src->height;
+	memcpy(view->data, src->data, sizeof(src->data));
+	memcpy(view->linesize, src->linesize, sizeof(src->linesize));
+	return view;
+}
+
+static void encode(AVCodecContext* ctx, AVFrame* frame, AVPacket* pkt)
+{
+	avcodec_send_frame(ctx, frame);
+	while (!avcodec_receive_packet(ctx, pkt)) {
+		av_packet_unref(pkt);
+	}
+}
+
+// in_fmt input encoded as enc_fmt. two_node runs the conversion the way an ff_vfilter node feeding x86_enc does:
+// on its own thread, into a rotating pool of image packets handed over through a queue, and the encoder gets each
+// one as a packet view it has to copy. Otherwise the conversion writes straight into the refcounted frame the
+// encoder consumes, as x86_enc does now; input already in the encoder's format is sent as a packet view
+static void run(const char* name, AVPixelFormat in_fmt, AVPixelFormat enc_fmt, bool two_node, int w, int h,
+                int frame_cnt)
+{
+	AVCodecContext* ctx = open_encoder(enc_fmt, w, h);
+	if (!ctx) {
+		cerr << name << ": cannot open libx264 for " << av_get_pix_fmt_name(enc_fmt) << endl;
+		return;
+	}
+	vector<AVFrame*> inputs;
+	for (int i = 0; i < 8; i++) {
+		inputs.push_back(alloc_frame(in_fmt, w, h));
+		fill_frame(inputs.back(), i);
+	}
+	vector<AVFrame*> pool;
+	for (int i = 0; i < (two_node ? POOL_SIZE : 1); i++) {
+		pool.push_back(alloc_frame(enc_fmt, w, h));
+	}
+	SwsContext* sws = in_fmt == enc_fmt ? NULL
+	                                    : sws_getContext(w, h, in_fmt, w, h, enc_fmt, SWS_BILINEAR, NULL, NULL, NULL);
+	AVPacket* pkt     = av_packet_alloc();
+	AVFrame* view     = av_frame_alloc();
+	auto start        = steady_clock::now();
+	clock_t cpu_start = clock();
+	if (two_node) {
+		mutex m;
+		condition_variable cv;
+		deque<int> free_slots, ready_slots;
+		for (int i = 0; i < POOL_SIZE; i++) {
+			free_slots.push_back(i);
+		}
+		thread filter([&] {
+			for (int i = 0; i < frame_cnt; i++) {
+				unique_lock<mutex> lock(m);
+				cv.wait(lock, [&] { return !free_slots.empty(); });
+				int slot = free_slots.front();
+				free_slots.pop_front();
+				lock.unlock();
+				AVFrame* in = inputs[i % inputs.size()];
+				sws_scale(sws, in->data, in->linesize, 0, h, pool[slot]->data, pool[slot]->linesize);
+				lock.lock();
+				ready_slots.push_back(slot);
+				cv.notify_all();
+			}
+		});
+		for (int i = 0; i < frame_cnt; i++) {
+			unique_lock<mutex> lock(m);
+			cv.wait(lock, [&] { return !ready_slots.empty(); });
+			int slot = ready_slots.front();
+			ready_slots.pop_front();
+			lock.unlock();
+			AVFrame* enc_frame = as_packet_view(pool[slot], view);
+			enc_frame->pts     = i;
+			encode(ctx, enc_frame, pkt);
+			// the encoder holds its own copy, so the image packet goes back to the pool
+			lock.lock();
+			free_slots.push_back(slot);
+			cv.notify_all();
+		}
+		filter.join();
+	} else {
+		for (int i = 0; i < frame_cnt; i++) {
+			AVFrame* in = inputs[i % inputs.size()];
+			AVFrame* enc_frame;
+			if (sws) {
+				enc_frame = pool[0];
+				av_frame_make_writable(enc_frame);
+				sws_scale(sws, in->data, in->linesize, 0, h, enc_frame->data, enc_frame->linesize);
+			} else {
+				enc_frame = as_packet_view(in, view);
+			}
+			enc_frame->pts = i;
+			encode(ctx, enc_frame, pkt);
+		}
+	}
+	encode(ctx, NULL, pkt);
+	double elapsed_s = duration<double>(steady_clock::now() - start).count();
+	double cpu_s     = (double)(clock() - cpu_start) / CLOCKS_PER_SEC;
+	cout << left << setw(16) << name << " fps:" << fixed << setprecision(1) << frame_cnt / elapsed_s
+	     << " cpu_ms_per_frame:" << setprecision(2) << cpu_s * 1000 / frame_cnt << endl;
+
+	av_frame_free(&view);
+	av_packet_free(&pkt);
+	sws_freeContext(sws);
+	for (auto& frame : inputs) {
+		av_frame_free(&frame);
+	}
+	for (auto& frame : pool) {
+		av_frame_free(&frame);
+	}
+	avcodec_free_context(&ctx);
+}
+
+int main(int argc, char** argv)
+{
+	int w         = argc > 1 ? stoi(argv[1]) : 1920;
+	int h         = argc > 2 ? stoi(argv[2]) : 1080;
+	int frame_cnt = argc > 3 ? stoi(argv[3]) : 300;
+	run("i420", AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV420P, false, w, h, frame_cnt);
+	run("bgr_two_node", AV_PIX_FMT_BGR24, AV_PIX_FMT_YUV420P, true, w, h, frame_cnt);
+	run("bgr_fused", AV_PIX_FMT_BGR24, AV_PIX_FMT_YUV420P, false, w, h, frame_cnt);
+	run("nv12_two_node", AV_PIX_FMT_NV12, AV_PIX_FMT_YUV420P, true, w, h, frame_cnt);
+	run("nv12_native", AV_PIX_FMT_NV12, AV_PIX_FMT_NV12, false, w, h, frame_cnt);
+	return 0;
+}
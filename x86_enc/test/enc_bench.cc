@@ -0,0 +1,135 @@
+// std headers
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+// sdk headers (ffmpeg)
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+}
+
+using namespace std;
+using namespace std::chrono;
+
+struct EncConfig
+{
+	const char* preset;
+	const char* tune;
+	int thread_type;
+};
+
+static const EncConfig enc_configs[] = {
+    {"ultrafast", "", FF_THREAD_FRAME},           {"superfast", "", FF_THREAD_FRAME},
+    {"veryfast", "", FF_THREAD_FRAME},            {"faster", "", FF_THREAD_FRAME},
+    {"medium", "", FF_THREAD_FRAME},              {"veryfast", "zerolatency", FF_THREAD_FRAME},
+    {"veryfast", "zerolatency", FF_THREAD_SLICE},
+};
+
+// fills a synthetic 4:2:0 frame with a moving gradient plus per-frame noise, so the encoder has both motion and
+// texture to spend bits on
+static void fill_frame(AVFrame* frame, int idx)
+{
+	uint32_t seed = idx * 2654435761u;
+	for (int y = 0; y < frame->height; y++) {
+		uint8_t* row = frame->data[0] + y * frame->linesize[0];
+		for (int x = 0; x < frame->width; x++) {
+			seed   = seed * 1664525u + 1013904223u;
+			row[x] = (uint8_t)(((x + y + idx * 4) & 0xff) / 2 + (seed >> 28));
+		}
+	}
+	for (int p = 1; p < 3; p++) {
+		for (int y = 0; y < frame->height / 2; y++) {
+			uint8_t* row = frame->data[p] + y * frame->linesize[p];
+			for (int x = 0; x < frame->width / 2; x++) {
+				row[x] = (uint8_t)(128 + ((x * p + idx) & 0x1f));
+			}
+		}
+	}
+}
+
+// encodes frame_cnt synthetic frames with one configuration and reports encode fps, process cpu time per frame
+// and the resulting bitrate at 30 fps
+static int run_config(AVCodecID codec_id, const EncConfig& config, int w, int h, int frame_cnt, int threads)
+{
+	const AVCodec* pCodec = avcodec_find_encoder(codec_id);
+	if (!pCodec) {
+		cerr << "no encoder for " << avcodec_get_name(codec_id) << endl;
+		return -1;
+	}
+	AVCodecContext* ctx = avcodec_alloc_context3(pCodec);
+	ctx->width          = w;
+	ctx->height         = h;
+	ctx->pix_fmt        = AV_PIX_FMT_YUV420P;
+	ctx->framerate      = {30, 1};
+	ctx->time_base      = {1, 30};
+	ctx->gop_size       = 30;
+	ctx->thread_count   = threads;
+	ctx->thread_type    = config.thread_type;
+	av_opt_set(ctx->priv_data, "preset", config.preset, 0);
+	if (*config.tune) {
+		av_opt_set(ctx->priv_data, "tune", config.tune, 0);
+	}
+	av_opt_set_int(ctx->priv_data, "crf", 23, 0);
+	if (avcodec_open2(ctx, pCodec, NULL)) {
+		cerr << "cannot open encoder " << avcodec_get_name(codec_id) << endl;
+		avcodec_free_context(&ctx);
+		return -1;
+	}
+
+	AVFrame* frame = av_frame_alloc();
+	frame->width   = w;
+	frame->height  = h;
+	frame->format  = AV_PIX_FMT_YUV420P;
+	av_frame_get_buffer(frame, 0);
+	AVPacket* pkt       = av_packet_alloc();
+	uint64_t bytes      = 0;
+	uint64_t packet_cnt = 0;
+	auto start          = steady_clock::now();
+	clock_t cpu_start   = clock();
+	for (int i = 0; i <= frame_cnt; i++) {
+		if (i < frame_cnt) {
+			av_frame_make_writable(frame);
+			fill_frame(frame, i);
+			frame->pts = i;
+		}
+		avcodec_send_frame(ctx, i < frame_cnt ? frame : NULL);
+		while (!avcodec_receive_packet(ctx, pkt)) {
+			bytes += pkt->size;
+			packet_cnt++;
+			av_packet_unref(pkt);
+		}
+	}
+	double elapsed_s = duration<double>(steady_clock::now() - start).count();
+	double cpu_s     = (double)(clock() - cpu_start) / CLOCKS_PER_SEC;
+	string name      = string(config.preset) + (*config.tune ? string("/") + config.tune : "") +
+	              (config.thread_type == FF_THREAD_SLICE ? "/slice" : "");
+	cout << left << setw(30) << name << " packets:" << packet_cnt << " fps:" << fixed << setprecision(1)
+	     << frame_cnt / elapsed_s << " cpu_ms_per_frame:" << setprecision(2) << cpu_s * 1000 / frame_cnt
+	     << " kbps@30fps:" << setprecision(0) << bytes * 8 * 30 / 1000.0 / frame_cnt << endl;
+
+	av_packet_free(&pkt);
+	av_frame_free(&frame);
+	avcodec_free_context(&ctx);
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2) {
+		cerr << "usage: " << argv[0] << " <h264|h265> [width] [height] [frames] [threads, 0 = one per core]" << endl;
+		return 1;
+	}
+	AVCodecID codec_id = string(argv[1]) == "h265" ? AV_CODEC_ID_H265 : AV_CODEC_ID_H264;
+	int w              = argc > 2 ? stoi(argv[2]) : 1920;
+	int h              = argc > 3 ? stoi(argv[3]) : 1080;
+	int frame_cnt      = argc > 4 ? stoi(argv[4]) : 300;
+	int threads        = argc > 5 ? stoi(argv[5]) : 0;
+	for (auto& config : enc_configs) {
+		run_config(codec_id, config, w, h, frame_cnt, threads);
+	}
+	return 0;
+}
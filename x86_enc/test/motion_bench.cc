@@ -0,0 +1,217 @@
+// std headers
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// sdk headers (ffmpeg)
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+}
+
+using namespace std;
+using namespace std::chrono;
+
+// x86_enc's motion gate defaults
+#define MOTION_THUMB_W 64
+#define MOTION_THUMB_H 36
+#define MOTION_MAD_THRESHOLD 2.5f
+#define MOTION_HOLD_US 2'000'000
+#define MOTION_IDLE_INTERVAL_US 1'000'000
+
+static vector<AVFrame*> frames;
+static AVRational frame_rate = {25, 1};
+
+// decodes up to max_frames frames of the input into I420 frames held in memory
+static bool load_frames(const string& input, int max_frames)
+{
+	AVFormatContext* fmt_ctx = NULL;
+	if (avformat_open_input(&fmt_ctx, input.c_str(), NULL, NULL) || avformat_find_stream_info(fmt_ctx, NULL) < 0) {
+		cerr << "cannot open " << input << endl;
+		return false;
+	}
+	int v_stream_idx = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+	if (v_stream_idx < 0) {
+		cerr << "no video stream in " << input << endl;
+		avformat_close_input(&fmt_ctx);
+		return false;
+	}
+	AVStream* stream = fmt_ctx->streams[v_stream_idx];
+	if (stream->avg_frame_rate.num) {
+		frame_rate = stream->avg_frame_rate;
+	}
+	const AVCodec* pCodec = avcodec_find_decoder(stream->codecpar->codec_id);
+	AVCodecContext* ctx   = avcodec_alloc_context3(pCodec);
+	avcodec_parameters_to_context(ctx, stream->codecpar);
+	avcodec_open2(ctx, pCodec, NULL);
+	AVPacket* pkt   = av_packet_alloc();
+	AVFrame* frame  = av_frame_alloc();
+	SwsContext* sws = NULL;
+	bool eof        = false;
+	while ((int)frames.size() < max_frames && !eof) {
+		eof = av_read_frame(fmt_ctx, pkt) < 0;
+		if (!eof && pkt->stream_index != v_stream_idx) {
+			av_packet_unref(pkt);
+			continue;
+		}
+		avcodec_send_packet(ctx, eof ? NULL : pkt);
+		av_packet_unref(pkt);
+		while ((int)frames.size() < max_frames && !avcodec_receive_frame(ctx, frame)) {
+			AVFrame* i420 = av_frame_alloc();
+			i420->format  = AV_PIX_FMT_YUV420P;
+			i420->width   = frame->width & ~1;
+			i420->height  = frame->height & ~1;
+			av_frame_get_buffer(i420, 0);
+			sws = sws_getCachedContext(sws, frame->width, frame->height, (AVPixelFormat)frame->format, i420->width,
+			                           i420->height, AV_PIX_FMT_YUV420P, SWS_BILINEAR, NULL, NULL, NULL);
+			sws_scale(sws, frame->data, frame->linesize, 0, frame->height, i420->data, i420->linesize);
+			frames.push_back(i420);
+			av_frame_unref(frame);
+		}
+	}
+	sws_freeContext(sws);
+	av_frame_free(&frame);
+	av_packet_free(&pkt);
+	avcodec_free_context(&ctx);
+	avformat_close_input(&fmt_ctx);
+	return !frames.empty();
+}
+
+// x86_enc's sad_u8
+static uint64_t sad_u8(const uint8_t* a, const uint8_t* b, size_t n)
+{
+	uint64_t sad = 0;
+	size_t i     = 0;
+#if defined(__SSE2__) && defined(__x86_64__)
+	__m128i acc = _mm_setzero_si128();
+	for (; i + 16 <= n; i += 16) {
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(a + i)),
+		                                      _mm_loadu_si128((const __m128i*)(b + i))));
+	}
+	sad = _mm_cvtsi128_si64(acc) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(acc, acc));
+#endif
+	for (; i < n; i++) {
+		sad += abs(a[i] - b[i]);
+	}
+	return sad;
+}
+
+// x86_enc's motion_gate_pass without detections: a luma thumbnail compared against the last encoded one
+struct MotionGate
+{
+	SwsContext* sws_ctx           = NULL;
+	vector<uint8_t> thumb         = vector<uint8_t>(MOTION_THUMB_W * MOTION_THUMB_H);
+	vector<uint8_t> ref           = vector<uint8_t>(MOTION_THUMB_W * MOTION_THUMB_H);
+	int64_t last_enc_pts          = INT64_MIN;
+	int64_t motion_hold_until_pts = INT64_MIN;
+
+	~MotionGate() { sws_freeContext(sws_ctx); }
+
+	bool pass(const AVFrame* input, int64_t pts)
+	{
+		sws_ctx = sws_getCachedContext(sws_ctx, input->width, input->height, (AVPixelFormat)input->format,
+		                               MOTION_THUMB_W, MOTION_THUMB_H, AV_PIX_FMT_GRAY8, SWS_AREA, NULL, NULL, NULL);
+		uint8_t* thumb_data[4] = {thumb.data(), NULL, NULL, NULL};
+		int thumb_linesize[4]  = {MOTION_THUMB_W, 0, 0, 0};
+		sws_scale(sws_ctx, input->data, input->linesize, 0, input->height, thumb_data, thumb_linesize);
+		bool motion = last_enc_pts == INT64_MIN || pts < last_enc_pts;
+		if (!motion) {
+			motion = (float)sad_u8(thumb.data(), ref.data(), thumb.size()) / thumb.size() >= MOTION_MAD_THRESHOLD;
+		}
+		if (motion) {
+			motion_hold_until_pts = pts + MOTION_HOLD_US;
+		}
+		if (pts >= motion_hold_until_pts && pts - last_enc_pts < MOTION_IDLE_INTERVAL_US) {
+			return false;
+		}
+		ref.swap(thumb);
+		last_enc_pts = pts;
+		return true;
+	}
+};
+
+// encodes the clip with libx264 (veryfast, crf 23), through the motion gate when gated, and reports the frames
+// encoded, the bitrate over the clip's duration, process cpu time per input frame and the gate's own share of it
+static void run_mode(const char* name, bool gated)
+{
+	const AVCodec* enc      = avcodec_find_encoder(AV_CODEC_ID_H264);
+	AVCodecContext* enc_ctx = avcodec_alloc_context3(enc);
+	enc_ctx->width          = frames[0]->width;
+	enc_ctx->height         = frames[0]->height;
+	enc_ctx->pix_fmt        = AV_PIX_FMT_YUV420P;
+	enc_ctx->framerate      = frame_rate;
+	enc_ctx->time_base      = {1, 1'000'000};
+	enc_ctx->max_b_frames   = 0;
+	av_opt_set(enc_ctx->priv_data, "preset", "veryfast", 0);
+	av_opt_set_int(enc_ctx->priv_data, "crf", 23, 0);
+	if (avcodec_open2(enc_ctx, enc, NULL)) {
+		cerr << "cannot open libx264" << endl;
+		return;
+	}
+	MotionGate gate;
+	AVPacket* pkt      = av_packet_alloc();
+	uint64_t bytes     = 0;
+	size_t encoded_cnt = 0;
+	double gate_cpu_s  = 0;
+	clock_t cpu_start  = clock();
+	auto start         = steady_clock::now();
+	auto drain         = [&] {
+		while (!avcodec_receive_packet(enc_ctx, pkt)) {
+			bytes += pkt->size;
+			av_packet_unref(pkt);
+		}
+	};
+	for (size_t i = 0; i < frames.size(); i++) {
+		AVFrame* frame = frames[i];
+		frame->pts     = av_rescale_q(i, av_inv_q(frame_rate), enc_ctx->time_base);
+		if (gated) {
+			clock_t gate_start = clock();
+			bool pass          = gate.pass(frame, frame->pts);
+			gate_cpu_s += (double)(clock() - gate_start) / CLOCKS_PER_SEC;
+			if (!pass) {
+				continue;
+			}
+		}
+		avcodec_send_frame(enc_ctx, frame);
+		encoded_cnt++;
+		drain();
+	}
+	avcodec_send_frame(enc_ctx, NULL);
+	drain();
+	double elapsed_s = duration<double>(steady_clock::now() - start).count();
+	double cpu_ms    = 1000.0 * (clock() - cpu_start) / CLOCKS_PER_SEC;
+	double kbps      = bytes * 8 * av_q2d(frame_rate) / 1000.0 / frames.size();
+	cout << left << setw(12) << name << " encoded:" << encoded_cnt << "/" << frames.size() << " kbps:" << fixed
+	     << setprecision(0) << kbps << " cpu_ms_per_frame:" << setprecision(2) << cpu_ms / frames.size()
+	     << " gate_us_per_frame:" << 1e6 * gate_cpu_s / frames.size() << " fps:" << setprecision(1)
+	     << frames.size() / elapsed_s << endl;
+	av_packet_free(&pkt);
+	avcodec_free_context(&enc_ctx);
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2) {
+		cerr << "usage: " << argv[0] << " <video file> [frames]" << endl;
+		return 1;
+	}
+	if (!load_frames(argv[1], argc > 2 ? stoi(argv[2]) : 300)) {
+		return 1;
+	}
+	run_mode("always", false);
+	run_mode("motion_gate", true);
+	for (auto& frame : frames) {
+		av_frame_free(&frame);
+	}
+	return 0;
+}
@@ -0,0 +1,86 @@
+// std headers
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <unordered_map>
+
+// local headers
+#include "../pts_ring.h"
+
+using namespace std;
+
+static atomic<uint64_t> alloc_cnt{0};
+
+void* operator new(size_t size)
+{
+	alloc_cnt++;
+	if (void* p = malloc(size)) {
+		return p;
+	}
+	throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+// coding order of an IBBP GOP as an encoder with two b-frames and some lookahead emits it: the reference frame
+// first, then the b-frames it closes
+static int64_t coding_order_pts(uint64_t idx)
+{
+	uint64_t group = idx / 3, pos = idx % 3;
+	int64_t base   = (int64_t)group * 3;
+	return (pos == 0 ? base + 2 : base + pos - 1) * 33'333;
+}
+
+// drives send/receive with the encoder delay of a lookahead window and reorders like the encoder, prints the heap
+// allocations made after the warm up and returns whether every packet found the sync timestamp of its frame
+template <class Push, class Pop>
+static bool run(const char* name, Push push, Pop pop, uint64_t frames, uint64_t delay)
+{
+	bool ok           = true;
+	uint64_t warm_cnt = 0;
+	for (uint64_t i = 0; i < frames; i++) {
+		if (i == 2 * delay) {
+			warm_cnt = alloc_cnt;
+		}
+		push((int64_t)i * 33'333, (int64_t)i * 33'333 + 1'000'000);
+		if (i >= delay) {
+			int64_t pts = coding_order_pts(i - delay);
+			int64_t sts = -1;
+			ok &= pop(pts, sts) && sts == pts + 1'000'000;
+		}
+	}
+	uint64_t steady_allocs = alloc_cnt - warm_cnt;
+	cout << name << ": " << (ok ? "timestamps ok" : "timestamps WRONG") << ", " << steady_allocs
+	     << " heap allocations in steady state" << endl;
+	return ok;
+}
+
+int main()
+{
+	const uint64_t frames = 100'000, delay = 48;
+
+	unordered_map<int64_t, int64_t> map;
+	run(
+	    "unordered_map", [&](int64_t pts, int64_t sts) { map[pts] = sts; },
+	    [&](int64_t pts, int64_t& sts) {
+		    auto it = map.find(pts);
+		    if (it == map.end()) {
+			    return false;
+		    }
+		    sts = it->second;
+		    map.erase(it);
+		    return true;
+	    },
+	    frames, delay);
+
+	static PtsRing<512> ring;
+	uint64_t before = alloc_cnt;
+	bool ok = run(
+	    "PtsRing", [&](int64_t pts, int64_t sts) { ring.push(pts, sts); },
+	    [&](int64_t pts, int64_t& sts) { return ring.pop(pts, sts); }, frames, delay);
+	bool no_alloc = alloc_cnt == before;
+	cout << (ok && no_alloc ? "PASS" : "FAIL") << endl;
+	return ok && no_alloc ? 0 : 1;
+}
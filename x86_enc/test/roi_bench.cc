@@ -0,0 +1,208 @@
+// std headers
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// sdk headers (ffmpeg)
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+}
+
+using namespace std;
+
+struct RoiMode
+{
+	const char* name;
+	bool roi;
+	float qoffset;
+	float bg_qoffset;
+};
+
+// plain encode, the x86_enc defaults, and a background-only variant that leaves the objects at the base quality
+static const RoiMode roi_modes[] = {
+    {"plain", false, 0.f, 0.f},
+    {"roi", true, -0.3f, 0.2f},
+    {"bg_only", true, 0.f, 0.4f},
+};
+
+static vector<AVFrame*> frames;
+static AVRational frame_rate = {25, 1};
+
+// decodes up to max_frames frames of the input into I420 frames held in memory
+static bool load_frames(const string& input, int max_frames)
+{
+	AVFormatContext* fmt_ctx = NULL;
+	if (avformat_open_input(&fmt_ctx, input.c_str(), NULL, NULL) || avformat_find_stream_info(fmt_ctx, NULL) < 0) {
+		cerr << "cannot open " << input << endl;
+		return false;
+	}
+	int v_stream_idx = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+	if (v_stream_idx < 0) {
+		cerr << "no video stream in " << input << endl;
+		avformat_close_input(&fmt_ctx);
+		return false;
+	}
+	AVStream* stream = fmt_ctx->streams[v_stream_idx];
+	if (stream->avg_frame_rate.num) {
+		frame_rate = stream->avg_frame_rate;
+	}
+	const AVCodec* pCodec = avcodec_find_decoder(stream->codecpar->codec_id);
+	AVCodecContext* ctx   = avcodec_alloc_context3(pCodec);
+	avcodec_parameters_to_context(ctx, stream->codecpar);
+	avcodec_open2(ctx, pCodec, NULL);
+	AVPacket* pkt   = av_packet_alloc();
+	AVFrame* frame  = av_frame_alloc();
+	SwsContext* sws = NULL;
+	bool eof        = false;
+	while ((int)frames.size() < max_frames && !eof) {
+		eof = av_read_frame(fmt_ctx, pkt) < 0;
+		if (!eof && pkt->stream_index != v_stream_idx) {
+			av_packet_unref(pkt);
+			continue;
+		}
+		avcodec_send_packet(ctx, eof ? NULL : pkt);
+		av_packet_unref(pkt);
+		while ((int)frames.size() < max_frames && !avcodec_receive_frame(ctx, frame)) {
+			AVFrame* i420 = av_frame_alloc();
+			i420->format  = AV_PIX_FMT_YUV420P;
+			i420->width   = frame->width & ~1;
+			i420->height  = frame->height & ~1;
+			av_frame_get_buffer(i420, 0);
+			sws = sws_getCachedContext(sws, frame->width, frame->height, (AVPixelFormat)frame->format, i420->width,
+			                           i420->height, AV_PIX_FMT_YUV420P, SWS_BILINEAR, NULL, NULL, NULL);
+			sws_scale(sws, frame->data, frame->linesize, 0, frame->height, i420->data, i420->linesize);
+			frames.push_back(i420);
+			av_frame_unref(frame);
+		}
+	}
+	sws_freeContext(sws);
+	av_frame_free(&frame);
+	av_packet_free(&pkt);
+	avcodec_free_context(&ctx);
+	avformat_close_input(&fmt_ctx);
+	return !frames.empty();
+}
+
+// squared luma error of a decoded frame against its source, inside and outside the rectangle
+static void add_error(const AVFrame* src, const AVFrame* dec, int rx, int ry, int rw, int rh, double& roi_sse,
+                      uint64_t& roi_px, double& bg_sse, uint64_t& bg_px)
+{
+	for (int y = 0; y < src->height; y++) {
+		const uint8_t* a = src->data[0] + y * src->linesize[0];
+		const uint8_t* b = dec->data[0] + y * dec->linesize[0];
+		for (int x = 0; x < src->width; x++) {
+			double d = (double)a[x] - b[x];
+			if (x >= rx && x < rx + rw && y >= ry && y < ry + rh) {
+				roi_sse += d * d;
+				roi_px++;
+			} else {
+				bg_sse += d * d;
+				bg_px++;
+			}
+		}
+	}
+}
+
+static double psnr(double sse, uint64_t px) { return sse ? 10 * log10(255.0 * 255.0 * px / sse) : 99; }
+
+// encodes every frame with libx264 at crf 23 and the mode's regions, decodes the stream back and reports its
+// bitrate and the luma PSNR inside and outside the region
+static void run_mode(const RoiMode& mode, int rx, int ry, int rw, int rh)
+{
+	int w                   = frames[0]->width;
+	int h                   = frames[0]->height;
+	const AVCodec* enc      = avcodec_find_encoder(AV_CODEC_ID_H264);
+	AVCodecContext* enc_ctx = avcodec_alloc_context3(enc);
+	enc_ctx->width          = w;
+	enc_ctx->height         = h;
+	enc_ctx->pix_fmt        = AV_PIX_FMT_YUV420P;
+	enc_ctx->framerate      = frame_rate;
+	enc_ctx->time_base      = av_inv_q(frame_rate);
+	enc_ctx->max_b_frames   = 0;
+	av_opt_set(enc_ctx->priv_data, "preset", "veryfast", 0);
+	av_opt_set_int(enc_ctx->priv_data, "crf", 23, 0);
+	const AVCodec* dec      = avcodec_find_decoder(AV_CODEC_ID_H264);
+	AVCodecContext* dec_ctx = avcodec_alloc_context3(dec);
+	if (avcodec_open2(enc_ctx, enc, NULL) || avcodec_open2(dec_ctx, dec, NULL)) {
+		cerr << "cannot open libx264 / h264 decoder" << endl;
+		return;
+	}
+	AVPacket* pkt      = av_packet_alloc();
+	AVFrame* decoded   = av_frame_alloc();
+	uint64_t bytes     = 0;
+	size_t decoded_cnt = 0;
+	double roi_sse = 0, bg_sse = 0;
+	uint64_t roi_px = 0, bg_px = 0;
+
+	auto drain = [&] {
+		while (!avcodec_receive_packet(enc_ctx, pkt)) {
+			bytes += pkt->size;
+			avcodec_send_packet(dec_ctx, pkt);
+			av_packet_unref(pkt);
+			while (!avcodec_receive_frame(dec_ctx, decoded) && decoded_cnt < frames.size()) {
+				add_error(frames[decoded_cnt++], decoded, rx, ry, rw, rh, roi_sse, roi_px, bg_sse, bg_px);
+				av_frame_unref(decoded);
+			}
+		}
+	};
+	for (size_t i = 0; i < frames.size(); i++) {
+		AVFrame* frame = frames[i];
+		frame->pts     = i;
+		av_frame_remove_side_data(frame, AV_FRAME_DATA_REGIONS_OF_INTEREST);
+		if (mode.roi) {
+			AVFrameSideData* sd =
+			    av_frame_new_side_data(frame, AV_FRAME_DATA_REGIONS_OF_INTEREST, 2 * sizeof(AVRegionOfInterest));
+			AVRegionOfInterest* rois = (AVRegionOfInterest*)sd->data;
+			rois[0]                  = {sizeof(AVRegionOfInterest), ry, ry + rh, rx, rx + rw,
+			                            av_make_q((int)(mode.qoffset * 1000), 1000)};
+			rois[1]                  = {sizeof(AVRegionOfInterest), 0, h, 0, w,
+			                            av_make_q((int)(mode.bg_qoffset * 1000), 1000)};
+		}
+		avcodec_send_frame(enc_ctx, frame);
+		drain();
+	}
+	avcodec_send_frame(enc_ctx, NULL);
+	drain();
+	avcodec_send_packet(dec_ctx, NULL);
+	while (!avcodec_receive_frame(dec_ctx, decoded) && decoded_cnt < frames.size()) {
+		add_error(frames[decoded_cnt++], decoded, rx, ry, rw, rh, roi_sse, roi_px, bg_sse, bg_px);
+		av_frame_unref(decoded);
+	}
+	double kbps = bytes * 8 * av_q2d(frame_rate) / 1000.0 / frames.size();
+	cout << left << setw(10) << mode.name << " kbps:" << fixed << setprecision(0) << kbps
+	     << " roi_psnr:" << setprecision(2) << psnr(roi_sse, roi_px) << " bg_psnr:" << psnr(bg_sse, bg_px) << endl;
+	av_frame_free(&decoded);
+	av_packet_free(&pkt);
+	avcodec_free_context(&dec_ctx);
+	avcodec_free_context(&enc_ctx);
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2) {
+		cerr << "usage: " << argv[0] << " <video file> [frames] [roi x y w h, default the centre ninth]" << endl;
+		return 1;
+	}
+	if (!load_frames(argv[1], argc > 2 ? stoi(argv[2]) : 300)) {
+		return 1;
+	}
+	int w  = frames[0]->width;
+	int h  = frames[0]->height;
+	int rx = argc > 6 ? stoi(argv[3]) : w / 3;
+	int ry = argc > 6 ? stoi(argv[4]) : h / 3;
+	int rw = argc > 6 ? stoi(argv[5]) : w / 3;
+	int rh = argc > 6 ? stoi(argv[6]) : h / 3;
+	for (auto& mode : roi_modes) {
+		run_mode(mode, rx, ry, rw, rh);
+	}
+	for (auto& frame : frames) {
+		av_frame_free(&frame);
+	}
+	return 0;
+}
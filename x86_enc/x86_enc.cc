@@ -13,10 +13,13 @@
 
 using namespace chrono;
 
-X86EncCalculator::~X86EncCalculator()
+EncRendition::~EncRendition()
 {
-	if (pFrame) {
-		av_frame_free(&pFrame);
+	for (auto& conv_frame : conv_frames) {
+		av_frame_free(&conv_frame);
+	}
+	if (pSwsCtx) {
+		sws_freeContext(pSwsCtx);
 	}
 	if (pPacket) {
 		av_packet_free(&pPacket);
@@ -33,19 +36,65 @@ X86EncCalculator::~X86EncCalculator()
 	}
 }
 
+X86EncCalculator::~X86EncCalculator()
+{
+	// the encode thread still needs the rung threads to encode the queued inputs, they are stopped after it
+	{
+		lock_guard<mutex> input_lock(input_m);
+		input_closed = true;
+	}
+	input_ready.notify_all();
+	input_space.notify_all();
+	AUP_AVAF_THREAD_JOIN_NOTERM(encode_thread_id);
+	if (latency_cnt || overflow_drop_cnt) {
+		log_metrics();
+	}
+	{
+		lock_guard<mutex> lock(m);
+		running_ = false;
+	}
+	frame_ready.notify_all();
+	frame_done.notify_all();
+	for (auto& r : renditions) {
+		AUP_AVAF_THREAD_JOIN_NOTERM(r->encode_thread_id);
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+		                  __func__ << " rendition " << r->idx << ": " << r->vpacket_pool.size() << " pooled vpackets, "
+		                           << r->vpacket_pool.get_alloc_cnt() << " allocations ("
+		                           << r->vpacket_pool.get_transient_cnt() << " beyond the pool), "
+		                           << r->vpacket_pool.get_trimmed_cnt() << " trimmed, " << r->conv_frames.size()
+		                           << " conversion frames reallocated " << r->conv_realloc_cnt << " times");
+	}
+	renditions.clear();
+	if (pFrame) {
+		av_frame_free(&pFrame);
+	}
+	if (motion_sws_ctx) {
+		sws_freeContext(motion_sws_ctx);
+	}
+	if (gated_frame_cnt) {
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+		                  __func__ << " " << gated_frame_cnt << " of " << send_img_packet_cnt
+		                           << " frames not encoded on a static scene");
+	}
+}
+
 ErrorCode X86EncCalculator::fill_contract(shared_ptr<Contract>& contract, string& err_str)
 {
-	if (contract->output_stream_names.size() != 2) {
-		err_str = "node must have exactly two outputs";
+	if (contract->output_stream_names.size() < 2 || contract->output_stream_names.size() % 2 != 0) {
+		err_str = "node must have one pair of outputs per rendition";
 		return ErrorCode::INVALID_CONTRACT;
 	}
 	need_i_img_stream_info_side_packet = !options->enc().w() || !options->enc().h() || !options->enc().fps();
-	if (need_i_img_stream_info_side_packet && contract->input_stream_names.size() != 2) {
-		err_str = "node requires side packets hence needs exactly two inputs streams";
+	// an extra last input carries detections that steer the encoder's bits (ROI encoding)
+	int base_input_cnt = need_i_img_stream_info_side_packet ? 2 : 1;
+	if (need_i_img_stream_info_side_packet && contract->input_stream_names.size() != 2 &&
+	    contract->input_stream_names.size() != 3) {
+		err_str = "node requires side packets hence needs two inputs streams, plus an optional detection stream";
 		return ErrorCode::INVALID_CONTRACT;
 	}
-	if (!need_i_img_stream_info_side_packet && contract->input_stream_names.size() != 1) {
-		err_str = "node does not require side packet so it needs exactly one input stream";
+	if (!need_i_img_stream_info_side_packet && contract->input_stream_names.size() != 1 &&
+	    contract->input_stream_names.size() != 2) {
+		err_str = "node does not require side packet so it needs one input stream, plus an optional detection stream";
 		return ErrorCode::INVALID_CONTRACT;
 	}
 	contract->sample_input_packets[0] = make_packet<ImagePacket>();
@@ -53,8 +102,15 @@ ErrorCode X86EncCalculator::fill_contract(shared_ptr<Contract>& contract, string
 		contract->sample_input_packets[1] = make_packet<VideoStreamInfoPacket>();
 		contract->input_attrs_arr[1].set_type(contract->input_attrs_arr[1].SIDE_PACKET);
 	}
-	contract->sample_output_packets[0] = make_packet<VideoPacket>();
-	contract->sample_output_packets[1] = make_packet<AVCodecContextPacket>();
+	if ((int)contract->input_stream_names.size() > base_input_cnt) {
+		vector<aup::detect::Detector::DetectedObject> res;
+		detections_input_idx                                 = base_input_cnt;
+		contract->sample_input_packets[detections_input_idx] = make_packet<DetectionPacket>(0, 0, 0, res, 0);
+	}
+	for (int i = 0; i < (int)contract->sample_output_packets.size(); i += 2) {
+		contract->sample_output_packets[i]     = make_packet<VideoPacket>();
+		contract->sample_output_packets[i + 1] = make_packet<AVCodecContextPacket>();
+	}
 	return ErrorCode::OK;
 }
 
@@ -81,6 +137,131 @@ static int32_t fps_to_av_rational(float fps, AVRational* av_rational_fps)
 	return 0;
 }
 
+// param values of ENC_OVERFLOW_BLOCK, ENC_OVERFLOW_DROP_OLDEST and ENC_OVERFLOW_DROP_NONREF
+static const char* const overflow_policy_names[] = {"block", "drop_oldest", "drop_nonref"};
+
+// the encoder knobs VideoCodecOptions has no fields for ride on the enc name, as '&' separated keys after a '#':
+//   preset=veryfast      x264/x265 preset (ultrafast ... medium), the encoder default when left out
+//   tune=zerolatency     x264/x265 tune, zerolatency drops lookahead and frame reordering delay
+//   lookahead=10         frames of rate control lookahead, the preset/tune value when left out
+//   sliced=1             1 splits each frame across threads (lower latency, less efficient), 0 uses frame threads
+//   ladder=720,360       heights the renditions below the top one pick from, instead of ENC_ABR_LADDER_HEIGHTS
+//   roi_qoffset=-0.3     quantizer offset of detected objects, -1 (best quality) ... 1 (worst)
+//   roi_bg_qoffset=0.2   quantizer offset of the rest of the picture while objects are present, 0 leaves it alone
+//   motion_gate=1        encodes a static scene once per ENC_MOTION_IDLE_INTERVAL_US, see motion_gate_pass
+//   overflow=block       full input queue policy: block, drop_oldest or drop_nonref, see execute
+// e.g. name: "x86_enc_h264#preset=veryfast&tune=zerolatency"
+bool X86EncCalculator::parse_enc_params(string& err_str)
+{
+	const string& name = options->enc().name();
+	size_t pos         = name.find('#');
+	if (pos == string::npos) {
+		return true;
+	}
+	string params = name.substr(pos + 1);
+	for (size_t key_pos = 0; key_pos < params.size();) {
+		size_t key_end = std::min(params.find('&', key_pos), params.size());
+		string key     = params.substr(key_pos, key_end - key_pos);
+		key_pos        = key_end + 1;
+		char* rest     = NULL;
+		if (!key.compare(0, 7, "preset=")) {
+			preset = key.substr(7);
+		} else if (!key.compare(0, 5, "tune=")) {
+			tune = key.substr(5);
+		} else if (!key.compare(0, 10, "lookahead=")) {
+			if (key.size() == 10 || (rc_lookahead = strtol(key.c_str() + 10, &rest, 10)) < 0 || *rest) {
+				err_str = "invalid lookahead in " + key;
+				return false;
+			}
+		} else if (key == "sliced=0" || key == "sliced=1") {
+			sliced_threads = key.back() - '0';
+		} else if (key == "motion_gate=0" || key == "motion_gate=1") {
+			motion_gate = key.back() == '1';
+		} else if (!key.compare(0, 9, "overflow=")) {
+			auto name_it = find(begin(overflow_policy_names), end(overflow_policy_names), key.substr(9));
+			if (name_it == end(overflow_policy_names)) {
+				err_str = "invalid overflow in " + key + ", expected block, drop_oldest or drop_nonref";
+				return false;
+			}
+			overflow_policy = name_it - begin(overflow_policy_names);
+		} else if (!key.compare(0, 12, "roi_qoffset=") || !key.compare(0, 15, "roi_bg_qoffset=")) {
+			size_t eq     = key.find('=');
+			float qoffset = strtof(key.c_str() + eq + 1, &rest);
+			if (key.size() == eq + 1 || *rest || qoffset < -1.f || qoffset > 1.f) {
+				err_str = "invalid quantizer offset in " + key + ", expected -1 ... 1";
+				return false;
+			}
+			(!key.compare(0, 12, "roi_qoffset=") ? roi_qoffset : roi_bg_qoffset) = qoffset;
+		} else if (!key.compare(0, 7, "ladder=")) {
+			ladder_heights.clear();
+			for (const char* height = key.c_str() + 7; *height; height = rest + (*rest == ',')) {
+				ladder_heights.push_back(strtol(height, &rest, 10));
+				if (ladder_heights.back() <= 0 || (*rest && *rest != ',')) {
+					err_str = "invalid ladder in " + key + ", expected heights like ladder=720,360";
+					return false;
+				}
+			}
+		} else {
+			err_str = "unknown key " + key + " in " + params;
+			return false;
+		}
+	}
+	return true;
+}
+
+// applies the thread count and the x264/x265 speed knobs before the encoder is opened; libx265 ignores the
+// context thread count, so its pool size and lookahead go through x265-params. With aligned IDRs scene cut
+// detection is turned off and forced I frames become IDRs, so every GOP opens on the gop_size cadence
+void X86EncCalculator::set_encoder_threading_opts(AVCodecContext* pVcodecCtx)
+{
+	int threads              = (options->enc().threads() > 0) ? options->enc().threads() : ENC_THREAD_COUNT_DEFAULT;
+	pVcodecCtx->thread_count = threads;
+	if (sliced_threads >= 0) {
+		pVcodecCtx->thread_type = sliced_threads ? FF_THREAD_SLICE : FF_THREAD_FRAME;
+	}
+	if (aligned_idr) {
+		pVcodecCtx->keyint_min = pVcodecCtx->gop_size;
+	}
+	if (pVcodecCtx->codec_id != AV_CODEC_ID_H264 && pVcodecCtx->codec_id != AV_CODEC_ID_H265) {
+		return;
+	}
+	if (preset.size() && av_opt_set(pVcodecCtx->priv_data, "preset", preset.c_str(), 0) < 0) {
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
+		                  __func__ << " encoder does not support preset " << preset);
+	}
+	if (tune.size() && av_opt_set(pVcodecCtx->priv_data, "tune", tune.c_str(), 0) < 0) {
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
+		                  __func__ << " encoder does not support tune " << tune);
+	}
+	if (aligned_idr) {
+		av_opt_set_int(pVcodecCtx->priv_data, "forced-idr", 1, 0);
+	}
+	string params;
+	if (pVcodecCtx->codec_id == AV_CODEC_ID_H264) {
+		if (rc_lookahead >= 0) {
+			av_opt_set_int(pVcodecCtx->priv_data, "rc-lookahead", rc_lookahead, 0);
+		}
+	} else {
+		if (threads > 0) {
+			params += "pools=" + to_string(threads) + ":";
+		}
+		if (rc_lookahead >= 0) {
+			params += "rc-lookahead=" + to_string(rc_lookahead) + ":";
+		}
+	}
+	if (aligned_idr) {
+		params += "scenecut=0:";
+	}
+	if (!params.empty()) {
+		params.pop_back();
+		av_opt_set(pVcodecCtx->priv_data, (pVcodecCtx->codec_id == AV_CODEC_ID_H264) ? "x264-params" : "x265-params",
+		           params.c_str(), 0);
+	}
+	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+	                  "        preset = " << preset << ", tune = " << tune << ", rc_lookahead = " << rc_lookahead
+	                                      << ", sliced_threads = " << sliced_threads);
+}
+
 ErrorCode X86EncCalculator::initialize(std::string& str_err)
 {
 	AVCodecID encId = AV_CODEC_ID_NONE;
@@ -98,6 +279,9 @@ ErrorCode X86EncCalculator::initialize(std::string& str_err)
 			str_err = " Not setting correct codec type, only support x86_enc_h264/x86_enc_h265/x86_enc_mpeg4";
 			return ErrorCode::ERROR;
 	}
+	if (!parse_enc_params(str_err)) {
+		return ErrorCode::ERROR;
+	}
 
 	if (need_i_img_stream_info_side_packet) {
 		auto ec = node->dequeue_block(1, i_img_stream_info);
@@ -105,9 +289,10 @@ ErrorCode X86EncCalculator::initialize(std::string& str_err)
 			str_err = "Issue reading side packet for stream info: " + to_string(ec);
 			return ec;
 		}
-		if (i_img_stream_info->pixfmt != PIXFMT_I420) {
+		if (i_img_stream_info->pixfmt != PIXFMT_I420 && i_img_stream_info->pixfmt != PIXFMT_NV12 &&
+		    i_img_stream_info->pixfmt != PIXFMT_BGR24) {
 
-			str_err = "X86 encoder only accept I420 input pixfmt";
+			str_err = "X86 encoder only accept I420, NV12 or BGR24 input pixfmt";
 			return ErrorCode::ERROR;
 		}
 	}
@@ -115,6 +300,7 @@ ErrorCode X86EncCalculator::initialize(std::string& str_err)
 	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO, __func__ << " video codec encoder options:");
 	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
 	                  "        name = " << CodecType_Name(options->enc().codec_type()));
+	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO, "        params = " << options->enc().name());
 	AUP_AVAF_LOG_NODE(
 	    node, GraphConfig::LoggingFilter::SEVERITY_INFO,
 	    "        width = " << to_string((options->enc().w() > 0) ? options->enc().w() : i_img_stream_info->w));
@@ -146,7 +332,64 @@ ErrorCode X86EncCalculator::initialize(std::string& str_err)
 		str_err = " Can not find encoder: " + string(avcodec_get_name(encId));
 		return ErrorCode::ERROR;
 	}
-	pVcodecCtx = avcodec_alloc_context3(pCodec);
+	if ((pFrame = av_frame_alloc()) == NULL) {
+		str_err = "Issue allocating av_frame";
+		return ErrorCode::NO_MEMORY;
+	}
+	int w = (options->enc().w() > 0) ? options->enc().w() : i_img_stream_info->w;
+	int h = (options->enc().h() > 0) ? options->enc().h() : i_img_stream_info->h;
+	if (ladder_heights.empty()) {
+		ladder_heights = ENC_ABR_LADDER_HEIGHTS;
+	}
+	renditions.resize(node->output_streams.size() / 2);
+	// several rungs switch GOP on the same input frame, and drop_nonref has to know which frames open a GOP
+	aligned_idr = renditions.size() > 1 || overflow_policy == ENC_OVERFLOW_DROP_NONREF;
+	for (uint32_t i = 0; i < (uint32_t)renditions.size(); i++) {
+		renditions[i].reset(new EncRendition());
+		renditions[i]->idx = i;
+	}
+	// every rung below the top one takes the next ladder height strictly below the rung above it, so a small input
+	// is never upscaled; the heights that are not smaller are skipped
+	size_t next_height = 0;
+	int rh_above       = h;
+	for (auto& r : renditions) {
+		// every rung keeps the aspect ratio of the configured size, with even dimensions for 4:2:0
+		int rw = w, rh = h;
+		if (r->idx) {
+			while (next_height < ladder_heights.size() && ((ladder_heights[next_height] + 1) & ~1) >= rh_above) {
+				next_height++;
+			}
+			if (next_height == ladder_heights.size()) {
+				str_err = "no ladder height below " + to_string(rh_above) + " left for rendition " + to_string(r->idx);
+				return ErrorCode::ERROR;
+			}
+			rh = (ladder_heights[next_height++] + 1) & ~1;
+			rw = (int)((int64_t)w * rh / h + 1) & ~1;
+		}
+		rh_above = rh;
+		auto ec = open_rendition(*r, pCodec, rw, rh, str_err);
+		if (ec != ErrorCode::OK) {
+			return ec;
+		}
+	}
+	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO, "        motion_gate = " << motion_gate);
+	input_queue_size = (options->enc().queue_size() > 0) ? options->enc().queue_size() : ENC_INPUT_QUEUE_SIZE_DEFAULT;
+	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+	                  "        input queue = " << input_queue_size
+	                                           << ", overflow policy = " << overflow_policy_names[overflow_policy]);
+	running_        = true;
+	last_metrics_us = get_now_us();
+	for (uint32_t i = 1; i < (uint32_t)renditions.size(); i++) {
+		renditions[i]->encode_thread_id = thread(&X86EncCalculator::rendition_thread, this, renditions[i].get());
+	}
+	encode_thread_id = thread(&X86EncCalculator::encode_thread, this);
+	return ErrorCode::OK;
+}
+
+ErrorCode X86EncCalculator::open_rendition(EncRendition& r, const AVCodec* pCodec, int w, int h, string& str_err)
+{
+	AVCodecID encId            = pCodec->id;
+	AVCodecContext* pVcodecCtx = r.pVcodecCtx = avcodec_alloc_context3(pCodec);
 	if (NULL == pVcodecCtx) {
 		str_err = "Fail to allocate encoder context";
 		return ErrorCode::ERROR;
@@ -154,6 +397,10 @@ ErrorCode X86EncCalculator::initialize(std::string& str_err)
 	pVcodecCtx->codec_id     = encId;
 	pVcodecCtx->codec_type   = AVMEDIA_TYPE_VIDEO;
 	pVcodecCtx->pix_fmt      = AV_PIX_FMT_YUV420P;
+	// x264 takes NV12 natively, everything else is converted into an I420 frame on the way in
+	if (need_i_img_stream_info_side_packet && i_img_stream_info->pixfmt == PIXFMT_NV12 && encId == AV_CODEC_ID_H264) {
+		pVcodecCtx->pix_fmt = AV_PIX_FMT_NV12;
+	}
 #if AUP_AVAF_PLATFORM_IS_U30_HOST
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wdeprecated-declarations"
@@ -162,8 +409,8 @@ ErrorCode X86EncCalculator::initialize(std::string& str_err)
 #if AUP_AVAF_PLATFORM_IS_U30_HOST
 #pragma GCC diagnostic pop
 #endif
-	pVcodecCtx->width        = (options->enc().w() > 0) ? options->enc().w() : i_img_stream_info->w;
-	pVcodecCtx->height       = (options->enc().h() > 0) ? options->enc().h() : i_img_stream_info->h;
+	pVcodecCtx->width        = w;
+	pVcodecCtx->height       = h;
 	fps_to_av_rational((options->enc().fps() > 0) ? options->enc().fps() : i_img_stream_info->fps,
 	                   &pVcodecCtx->framerate);
 	pVcodecCtx->time_base = av_inv_q(pVcodecCtx->framerate);
@@ -180,10 +427,12 @@ ErrorCode X86EncCalculator::initialize(std::string& str_err)
 #pragma GCC diagnostic pop
 #endif
 	if (options->enc().bitrate() > 100000) {
+		// lower rungs get the configured bitrate scaled by their share of the top rung's pixels
+		AVCodecContext* top_ctx = renditions[0]->pVcodecCtx;
+		pVcodecCtx->bit_rate    = options->enc().bitrate() * ((double)w * h / (top_ctx->width * top_ctx->height));
 		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
 		                  __func__ << " enc use CBR ratecontrol mode target bitrate: "
-		                           << to_string(options->enc().bitrate() / 1000) << " kbit/s");
-		pVcodecCtx->bit_rate           = options->enc().bitrate();
+		                           << to_string(pVcodecCtx->bit_rate / 1000) << " kbit/s");
 		pVcodecCtx->rc_min_rate        = pVcodecCtx->bit_rate;
 		pVcodecCtx->rc_max_rate        = pVcodecCtx->bit_rate;
 		pVcodecCtx->bit_rate_tolerance = pVcodecCtx->bit_rate;
@@ -196,61 +445,393 @@ ErrorCode X86EncCalculator::initialize(std::string& str_err)
 	pVcodecCtx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
 	pVcodecCtx->strict_std_compliance = FF_COMPLIANCE_EXPERIMENTAL;
 	pVcodecCtx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+	set_encoder_threading_opts(pVcodecCtx);
 	if (avcodec_open2(pVcodecCtx, pCodec, NULL)) {
 		str_err = "Could not open x86 encoder for " + string(avcodec_get_name(pVcodecCtx->codec_id));
 		return ErrorCode::ERROR;
 	}
+	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+	                  __func__ << " rendition " << r.idx << " " << w << "x" << h << " opened with "
+	                           << pVcodecCtx->thread_count << " threads, "
+	                           << ((pVcodecCtx->thread_type == FF_THREAD_SLICE) ? "slice" : "frame") << " threading");
 	auto av_codec_context_packet = make_packet<AVCodecContextPacket>(pVcodecCtx);
-	node->enqueue(1, av_codec_context_packet);
-	if ((pFrame = av_frame_alloc()) == NULL) {
-		str_err = "Issue allocating av_frame";
-		return ErrorCode::NO_MEMORY;
-	}
-	if ((pPacket = av_packet_alloc()) == NULL) {
+	node->enqueue(2 * r.idx + 1, av_codec_context_packet);
+	if ((r.pPacket = av_packet_alloc()) == NULL) {
 		str_err = "Issue allocating av_packet";
 		return ErrorCode::NO_MEMORY;
 	}
-#if AUP_AVAF_PLATFORM_IS_U30_HOST || AUP_AVAF_PLATFORM_IS_KRIA_SOM
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
-#endif
-	av_init_packet(pPacket);
-#if AUP_AVAF_PLATFORM_IS_U30_HOST || AUP_AVAF_PLATFORM_IS_KRIA_SOM
-#pragma GCC diagnostic pop
-#endif
 	return ErrorCode::OK;
 }
 
+// frames already in the rung's size and format are sent as they are; anything else (BGR24, NV12 for x265 and
+// mpeg4, another size, the rungs below the top one) is converted by swscale straight into a conversion frame, which
+// the encoder consumes, so no intermediate image packet or extra full-frame pass is needed. Encoders may keep a
+// reference to the frames they were sent (mpeg4 does while reordering b-frames), so the rung rotates through up
+// to ENC_CONV_FRAME_CNT frames and converts into one nothing references anymore instead of reallocating
+AVFrame* X86EncCalculator::to_encoder_frame(EncRendition& r, AVFrame* src)
+{
+	AVCodecContext* pVcodecCtx = r.pVcodecCtx;
+	if (src->format == pVcodecCtx->pix_fmt && src->width == pVcodecCtx->width && src->height == pVcodecCtx->height) {
+		return src;
+	}
+	AVFrame* conv_frame = NULL;
+	for (size_t i = 0; i < r.conv_frames.size() && !conv_frame; i++) {
+		size_t idx = (r.next_conv_frame + i) % r.conv_frames.size();
+		if (av_frame_is_writable(r.conv_frames[idx])) {
+			conv_frame        = r.conv_frames[idx];
+			r.next_conv_frame = idx + 1;
+		}
+	}
+	if (!conv_frame && r.conv_frames.size() < ENC_CONV_FRAME_CNT) {
+		if ((conv_frame = av_frame_alloc()) == NULL) {
+			return NULL;
+		}
+		conv_frame->format = pVcodecCtx->pix_fmt;
+		conv_frame->width  = pVcodecCtx->width;
+		conv_frame->height = pVcodecCtx->height;
+		if (av_frame_get_buffer(conv_frame, 0) < 0) {
+			av_frame_free(&conv_frame);
+			return NULL;
+		}
+		if (r.conv_frames.empty()) {
+			AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+			                  __func__ << " rendition " << r.idx << " converting "
+			                           << av_get_pix_fmt_name((AVPixelFormat)src->format) << " " << src->width << "x"
+			                           << src->height << " input to " << av_get_pix_fmt_name(pVcodecCtx->pix_fmt)
+			                           << " " << pVcodecCtx->width << "x" << pVcodecCtx->height);
+		}
+		r.conv_frames.push_back(conv_frame);
+		r.next_conv_frame = r.conv_frames.size();
+	}
+	if (!conv_frame) {
+		// the encoder holds every conversion frame, the next one in turn gets a new buffer
+		conv_frame        = r.conv_frames[r.next_conv_frame % r.conv_frames.size()];
+		r.next_conv_frame = r.next_conv_frame % r.conv_frames.size() + 1;
+		r.conv_realloc_cnt++;
+		if (av_frame_make_writable(conv_frame) < 0) {
+			return NULL;
+		}
+	}
+	r.pSwsCtx = sws_getCachedContext(r.pSwsCtx, src->width, src->height, (AVPixelFormat)src->format,
+	                                 conv_frame->width, conv_frame->height, (AVPixelFormat)conv_frame->format,
+	                                 ENC_SWS_FLAGS, NULL, NULL, NULL);
+	if (!r.pSwsCtx) {
+		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_ERROR,
+		                  __func__ << " no scaler from " << av_get_pix_fmt_name((AVPixelFormat)src->format));
+		return NULL;
+	}
+	sws_scale(r.pSwsCtx, src->data, src->linesize, 0, src->height, conv_frame->data, conv_frame->linesize);
+	conv_frame->pts = src->pts;
+	return conv_frame;
+}
+
 ErrorCode X86EncCalculator::execute()
 {
 	AUP_AVAF_DBG("execute start");
-	PacketPtr<const ImagePacket> vfrm;
-	auto ec = node->get_packet(0, vfrm);
+	EncInput in;
+	auto ec = node->get_packet(0, in.vfrm);
 	if (ec != ErrorCode::OK) {
 		return ec;
 	}
 	send_img_packet_cnt++;
+	if (detections_input_idx >= 0 && node->get_packet(detections_input_idx, in.detections) != ErrorCode::OK) {
+		in.detections = nullptr;
+	}
+	in.queued_us = get_now_us();
+	// the GOP cadence of the renditions is counted on input frames, so it survives dropped and gated frames
+	in.gop_start = aligned_idr && queued_frame_cnt++ % renditions[0]->pVcodecCtx->gop_size == 0;
+
+	unique_lock<mutex> lock(input_m);
+	if (overflow_policy == ENC_OVERFLOW_BLOCK) {
+		input_space.wait(lock, [&] { return input_closed || input_queue.size() < input_queue_size; });
+	}
+	if (input_closed) {
+		return ErrorCode::OK;
+	}
+	if (input_queue.size() >= input_queue_size) {
+		auto victim = input_queue.begin();
+		if (overflow_policy == ENC_OVERFLOW_DROP_NONREF) {
+			// keep the frames that open a GOP, the encoder's own reference choices are not known before encoding;
+			// aligned_idr puts every IDR on such a frame, with one rendition as with several
+			victim = find_if(input_queue.begin(), input_queue.end(), [](const EncInput& e) { return !e.gop_start; });
+			if (victim == input_queue.end()) {
+				victim = input_queue.begin();
+			}
+		}
+		if (victim->gop_start) {
+			(next(victim) != input_queue.end() ? next(victim)->gop_start : in.gop_start) = true;
+		}
+		input_queue.erase(victim);
+		overflow_drop_cnt++;
+	}
+	input_queue.push_back(std::move(in));
+	input_ready.notify_one();
+	return ErrorCode::OK;
+}
+
+// pops queued inputs and encodes them, so a slow preset never stalls the calculator thread and upstream. Once the
+// input is closed the queue is drained and every encoder flushed, so no frame accepted by execute is lost
+void X86EncCalculator::encode_thread()
+{
+	AUP_AVAF_HANDLE_THREAD_NAME();
+	while (true) {
+		EncInput in;
+		{
+			unique_lock<mutex> lock(input_m);
+			input_ready.wait(lock, [&] { return input_closed || !input_queue.empty(); });
+			if (input_queue.empty()) {
+				break;
+			}
+			queue_depth_max = max(queue_depth_max, (uint32_t)input_queue.size());
+			in              = std::move(input_queue.front());
+			input_queue.pop_front();
+			input_space.notify_one();
+		}
+		if (!encode_input(in)) {
+			continue;
+		}
+		timestamp_t now_us     = get_now_us();
+		timestamp_t latency_us = now_us - in.queued_us;
+		latency_sum_us += latency_us;
+		latency_max_us = max(latency_max_us, latency_us);
+		latency_cnt++;
+		if (now_us - last_metrics_us >= ENC_METRICS_INTERVAL_US) {
+			log_metrics();
+			last_metrics_us = now_us;
+		}
+	}
+	// the rung threads are idle between inputs, so the encoders can be flushed from here
+	for (auto& r : renditions) {
+		flush_encoder(*r);
+	}
+}
+
+void X86EncCalculator::log_metrics()
+{
+	size_t depth;
+	uint64_t drop_cnt;
+	{
+		lock_guard<mutex> lock(input_m);
+		depth    = input_queue.size();
+		drop_cnt = overflow_drop_cnt;
+	}
+	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+	                  __func__ << " encode latency avg " << (latency_cnt ? latency_sum_us / latency_cnt : 0)
+	                           << " us, max " << latency_max_us << " us over " << latency_cnt
+	                           << " frames, queue depth " << depth << " (max " << queue_depth_max << "/"
+	                           << input_queue_size << "), " << drop_cnt << " frames dropped on overflow");
+	latency_sum_us  = 0;
+	latency_max_us  = 0;
+	latency_cnt     = 0;
+	queue_depth_max = 0;
+}
+
+// gates, scales and encodes one input on every rung; false when nothing was encoded
+bool X86EncCalculator::encode_input(EncInput& in)
+{
+	auto& vfrm = in.vfrm;
 	vfrm->get_ffmpeg_avframe(pFrame);
+	if (motion_gate && !motion_gate_pass(pFrame, vfrm->get_pres_timestamp(),
+	                                     in.detections && !in.detections->detections.empty())) {
+		gated_frame_cnt++;
+		idr_pending |= in.gop_start;
+		return false;
+	}
+	bool force_idr = in.gop_start || idr_pending;
+	idr_pending    = false;
+	// scale once into a pyramid, each rung from the one above it
+	AVFrame* src = pFrame;
+	for (auto& r : renditions) {
+		if ((r->enc_frame = to_encoder_frame(*r, src)) == NULL) {
+			AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_ERROR,
+			                  __func__ << " convert vfrm failed for rendition " << r->idx
+			                           << ", pts:" << vfrm->get_pres_timestamp());
+			return false;
+		}
+		if (aligned_idr) {
+			// every rung starts its GOP on the same input frame, so players can switch renditions at any IDR and
+			// drop_nonref knows the frames that open one
+			r->enc_frame->pict_type = force_idr ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+		}
+		if (detections_input_idx >= 0) {
+			attach_roi(r->enc_frame, pFrame, in.detections);
+		}
+		src = r->enc_frame;
+	}
+	{
+		lock_guard<mutex> lock(m);
+		frame_pts          = vfrm->get_pres_timestamp();
+		frame_sts          = vfrm->get_sync_timestamp();
+		pending_renditions = renditions.size() - 1;
+		frame_seq++;
+	}
+	frame_ready.notify_all();
+	encode_frame(*renditions[0], vfrm->get_pres_timestamp(), vfrm->get_sync_timestamp());
+	unique_lock<mutex> lock(m);
+	frame_done.wait(lock, [&] { return !pending_renditions || !running_; });
+	return true;
+}
+
+// sum of absolute differences of two byte buffers, 16 bytes per instruction where SSE2 is available
+static uint64_t sad_u8(const uint8_t* a, const uint8_t* b, size_t n)
+{
+	uint64_t sad = 0;
+	size_t i     = 0;
+#if defined(__SSE2__) && defined(__x86_64__)
+	__m128i acc = _mm_setzero_si128();
+	for (; i + 16 <= n; i += 16) {
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(a + i)),
+		                                      _mm_loadu_si128((const __m128i*)(b + i))));
+	}
+	sad = _mm_cvtsi128_si64(acc) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(acc, acc));
+#endif
+	for (; i < n; i++) {
+		sad += abs(a[i] - b[i]);
+	}
+	return sad;
+}
+
+// decides whether an input frame is encoded: its luma is shrunk to an ENC_MOTION_THUMB_W x ENC_MOTION_THUMB_H
+// thumbnail and compared against the thumbnail of the last encoded frame. Motion, or any detected object, keeps
+// the full rate for ENC_MOTION_HOLD_US; a static scene is encoded once per ENC_MOTION_IDLE_INTERVAL_US
+bool X86EncCalculator::motion_gate_pass(const AVFrame* input, timestamp_t pts, bool has_objects)
+{
+	motion_sws_ctx = sws_getCachedContext(motion_sws_ctx, input->width, input->height, (AVPixelFormat)input->format,
+	                                      ENC_MOTION_THUMB_W, ENC_MOTION_THUMB_H, AV_PIX_FMT_GRAY8, SWS_AREA, NULL,
+	                                      NULL, NULL);
+	if (!motion_sws_ctx) {
+		return true;
+	}
+	uint8_t* thumb_data[4] = {motion_thumb.data(), NULL, NULL, NULL};
+	int thumb_linesize[4]  = {ENC_MOTION_THUMB_W, 0, 0, 0};
+	sws_scale(motion_sws_ctx, input->data, input->linesize, 0, input->height, thumb_data, thumb_linesize);
+
+	bool motion = has_objects || last_enc_pts == timestamp_min || pts < last_enc_pts;
+	if (!motion) {
+		uint64_t sad = sad_u8(motion_thumb.data(), motion_ref.data(), motion_thumb.size());
+		motion       = (float)sad / motion_thumb.size() >= ENC_MOTION_MAD_THRESHOLD;
+	}
+	if (motion) {
+		motion_hold_until_pts = pts + ENC_MOTION_HOLD_US;
+	}
+	if (pts >= motion_hold_until_pts && pts - last_enc_pts < ENC_MOTION_IDLE_INTERVAL_US) {
+		return false;
+	}
+	motion_ref.swap(motion_thumb);
+	last_enc_pts = pts;
+	return true;
+}
+
+// marks the detected objects (in input frame pixels) as regions of interest of one rung's picture: objects get
+// roi_qoffset, the rest of the picture roi_bg_qoffset. The pictures are reused across inputs, so the side
+// data of the previous input is dropped first
+void X86EncCalculator::attach_roi(AVFrame* enc_frame, const AVFrame* input,
+                                  PacketPtr<const DetectionPacket>& detections)
+{
+	av_frame_remove_side_data(enc_frame, AV_FRAME_DATA_REGIONS_OF_INTEREST);
+	if (!detections || detections->detections.empty()) {
+		return;
+	}
+	size_t roi_cnt = detections->detections.size() + (roi_bg_qoffset != 0.f);
+	AVFrameSideData* side_data =
+	    av_frame_new_side_data(enc_frame, AV_FRAME_DATA_REGIONS_OF_INTEREST, roi_cnt * sizeof(AVRegionOfInterest));
+	if (!side_data) {
+		return;
+	}
+	// the first region in the array wins where regions overlap, so the objects go before the background
+	AVRegionOfInterest* rois = (AVRegionOfInterest*)side_data->data;
+	float sx                 = (float)enc_frame->width / input->width;
+	float sy                 = (float)enc_frame->height / input->height;
+	for (auto& det : detections->detections) {
+		float mx        = det.rect.width * ENC_ROI_MARGIN;
+		float my        = det.rect.height * ENC_ROI_MARGIN;
+		rois->self_size = sizeof(AVRegionOfInterest);
+		rois->left      = max(0, (int)((det.rect.x - mx) * sx));
+		rois->top       = max(0, (int)((det.rect.y - my) * sy));
+		rois->right     = min(enc_frame->width, (int)((det.rect.x + det.rect.width + mx) * sx));
+		rois->bottom    = min(enc_frame->height, (int)((det.rect.y + det.rect.height + my) * sy));
+		rois->qoffset   = av_make_q((int)(roi_qoffset * 1000), 1000);
+		rois++;
+	}
+	if (roi_bg_qoffset != 0.f) {
+		rois->self_size = sizeof(AVRegionOfInterest);
+		rois->left      = 0;
+		rois->top       = 0;
+		rois->right     = enc_frame->width;
+		rois->bottom    = enc_frame->height;
+		rois->qoffset   = av_make_q((int)(roi_bg_qoffset * 1000), 1000);
+	}
+}
+
+void X86EncCalculator::rendition_thread(EncRendition* r)
+{
+	AUP_AVAF_HANDLE_THREAD_NAME();
+	uint64_t done_seq = 0;
+	while (true) {
+		timestamp_t pts, sts;
+		{
+			unique_lock<mutex> lock(m);
+			frame_ready.wait(lock, [&] { return !running_ || frame_seq != done_seq; });
+			if (!running_) {
+				return;
+			}
+			done_seq = frame_seq;
+			pts      = frame_pts;
+			sts      = frame_sts;
+		}
+		encode_frame(*r, pts, sts);
+		{
+			lock_guard<mutex> lock(m);
+			pending_renditions--;
+		}
+		frame_done.notify_one();
+	}
+}
+
+// sends the rung's picture of the current input to its encoder and forwards every packet the encoder has ready
+void X86EncCalculator::encode_frame(EncRendition& r, timestamp_t pts, timestamp_t sts)
+{
 	// send the frame to encoder
-	if (avcodec_send_frame(pVcodecCtx, pFrame)) {
+	if (avcodec_send_frame(r.pVcodecCtx, r.enc_frame)) {
 
 		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_ERROR,
-		                  __func__ << " send " << send_img_packet_cnt << " vfrm failed, resolution:" << pFrame->width
-		                           << "x" << pFrame->height << ", pts:" << vfrm->get_pres_timestamp());
+		                  __func__ << " send " << send_img_packet_cnt << " vfrm failed, resolution:"
+		                           << r.enc_frame->width << "x" << r.enc_frame->height << ", pts:" << pts);
 
 	} else {
 
 		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
-		                  __func__ << " send " << send_img_packet_cnt << " vfrm done, resolution:" << pFrame->width
-		                           << "x" << pFrame->height << ", pts:" << vfrm->get_pres_timestamp());
+		                  __func__ << " send " << send_img_packet_cnt << " vfrm done, resolution:"
+		                           << r.enc_frame->width << "x" << r.enc_frame->height << ", pts:" << pts);
 
-		pts_to_sts[vfrm->get_pres_timestamp()] = vfrm->get_sync_timestamp();
+		if (!r.pts_to_sts.push(pts, sts)) {
+			AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_WARN,
+			                  __func__ << " more than " << ENC_PTS_RING_SIZE
+			                           << " frames inside the encoder, oldest sync timestamp forgotten");
+		}
 	}
-	// try to receive the encoded video packets
+	receive_packets(r);
+}
+
+// enters the encoder's draining mode and forwards the packets of the frames it still holds
+void X86EncCalculator::flush_encoder(EncRendition& r)
+{
+	if (avcodec_send_frame(r.pVcodecCtx, NULL)) {
+		return;
+	}
+	receive_packets(r);
+	AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
+	                  __func__ << " rendition " << r.idx << " flushed after " << r.recv_vpacket_cnt << " vpkts");
+}
+
+// forwards every packet the encoder has ready, until it needs more input or, once flushed, reaches its end
+void X86EncCalculator::receive_packets(EncRendition& r)
+{
+	AVPacket* pPacket = r.pPacket;
 	while (true) {
-		auto recv_packet_code = avcodec_receive_packet(pVcodecCtx, pPacket);
+		auto recv_packet_code = avcodec_receive_packet(r.pVcodecCtx, pPacket);
 		if (recv_packet_code) {
-			return ErrorCode::OK;
+			return;
 		}
 		if (pPacket->size <= 0) {
 #if AUP_AVAF_PLATFORM_IS_U30_HOST || AUP_AVAF_PLATFORM_IS_KRIA_SOM
@@ -263,41 +844,35 @@ ErrorCode X86EncCalculator::execute()
 #endif
 			continue;
 		}
-		recv_vpacket_cnt++;
+		r.recv_vpacket_cnt++;
 
 		AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_INFO,
-		                  __func__ << " recv " << recv_vpacket_cnt << " vpkt done, len:" << pPacket->size
+		                  __func__ << " recv " << r.recv_vpacket_cnt << " vpkt done, len:" << pPacket->size
 		                           << ", pts:" << pPacket->pts << ",dts:" << pPacket->dts);
 
+		// packets sharing a pts with the previous one keep its sync timestamp
+		int64_t pkt_sts = r.last_retrieved_sts;
+		r.pts_to_sts.pop(pPacket->pts, pkt_sts);
+		r.last_retrieved_sts = pkt_sts;
+		// the packet comes from the rendition's pool once downstream has released it, so a steady stream only
+		// pays the copy
 		bool success;
-		auto vpkt = make_packet<VideoPacket>(pts_to_sts[pPacket->pts], pPacket->dts, (uint32_t)pPacket->size, success);
-		if (last_retrieved_pts != pPacket->pts) {
-			pts_to_sts.erase(last_retrieved_pts);
-		}
-		last_retrieved_pts = pPacket->pts;
-		vpkt->len          = pPacket->size;
-		vpkt->picType      = (pPacket->flags & AV_PKT_FLAG_KEY) ? PicType::I : PicType::NONE;
+		auto vpkt = r.vpacket_pool.acquire(pkt_sts, pPacket->dts, (uint32_t)pPacket->size, success);
 		if (success) {
+			vpkt->len     = pPacket->size;
+			vpkt->picType = (pPacket->flags & AV_PKT_FLAG_KEY) ? PicType::I : PicType::NONE;
 			vpkt->set_pres_timestamp(pPacket->pts);
 			memcpy(vpkt->pBuf, pPacket->data, pPacket->size);
-			if (node->enqueue(0, vpkt) != ErrorCode::OK) {
+			if (node->enqueue(2 * r.idx, vpkt) != ErrorCode::OK) {
 				AUP_AVAF_LOG_NODE(node, GraphConfig::LoggingFilter::SEVERITY_ERROR,
 				                  __func__ << " vpacket(pts:" << vpkt->get_pres_timestamp() << ") enqueue to "
-				                           << node->output_streams[0].first << " failed");
+				                           << node->output_streams[2 * r.idx].first << " failed");
 			}
 		}
 
+		// unref returns the encoder's buffer to its pool and resets the packet, no re-init needed
 		av_packet_unref(pPacket);
-#if AUP_AVAF_PLATFORM_IS_U30_HOST || AUP_AVAF_PLATFORM_IS_KRIA_SOM
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
-#endif
-		av_init_packet(pPacket);
-#if AUP_AVAF_PLATFORM_IS_U30_HOST || AUP_AVAF_PLATFORM_IS_KRIA_SOM
-#pragma GCC diagnostic pop
-#endif
 	}
-	return ErrorCode::OK;
 }
 AUP_AVAF_REGISTER_CALCULATOR("Aupera", "x86_enc", X86EncCalculator, VideoCodecOptions,
                              "Aupera's x86 encoder calculator.", {})
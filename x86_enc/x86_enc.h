@@ -1,12 +1,19 @@
 #pragma once
 
 // std headers
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <math.h>
 #include <semaphore.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <thread>
 #include <unistd.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 // sdk headers
 #include <boost/log/common.hpp>
@@ -21,6 +28,7 @@ extern "C"
 #include "libavutil/imgutils.h"
 #include "libavutil/mathematics.h"
 #include "libavutil/opt.h"
+#include "libavutil/pixdesc.h"
 #include "libavutil/time.h"
 #include "libswscale/swscale.h"
 }
@@ -29,30 +37,142 @@ extern "C"
 #include "aup/avaf/calculator.h"
 #include "aup/avaf/graph.h"
 #include "aup/avaf/node.h"
+#include "aup/avaf/packets/detection_packet.h"
 #include "aup/avaf/packets/image_packet.h"
 #include "aup/avaf/packets/video_packet.h"
 #include "aup/avaf/packets/video_stream_info_packet.h"
 #include "aup/avaf/utils.h"
 #include "aup/avap/vcodec.pb.h"
 
+// local headers
+#include "../stream_demux/video_packet_pool.h"
+#include "pts_ring.h"
+
 #define IMG_STREAM_INFO_WAIT_TIMEOUT 30000000
+#define ENC_THREAD_COUNT_DEFAULT 0  // used when the threads option is unset, 0 lets the encoder pick per core
+#define ENC_PTS_RING_SIZE 512       // frames in flight inside the encoder whose sync timestamps are remembered
+#define ENC_PACKET_POOL_SIZE 288    // recycled output VideoPackets per rendition: stream_mux's MUX_QUEUE_SIZE (256)
+                                    // plus its graph input queue and the packet being written
+#define ENC_CONV_FRAME_CNT 4        // conversion frames per rendition the encoder may still reference while reordering
+#define ENC_SWS_FLAGS SWS_BILINEAR
+#define ENC_ABR_LADDER_HEIGHTS {1080, 720, 360, 180} // rung heights below the configured size, unless ladder= is set
+#define ENC_ROI_QOFFSET_DEFAULT -0.3f   // quantizer offset of detected objects, -1 (best quality) ... 1 (worst)
+#define ENC_ROI_BG_QOFFSET_DEFAULT 0.2f // quantizer offset of the rest of the picture while objects are present
+#define ENC_ROI_MARGIN 0.1f             // object boxes grow by this share of their size on each side
+#define ENC_MOTION_THUMB_W 64                 // luma thumbnail the motion gate compares
+#define ENC_MOTION_THUMB_H 36
+#define ENC_MOTION_MAD_THRESHOLD 2.5f         // mean absolute thumbnail difference that counts as motion
+#define ENC_MOTION_HOLD_US 2'000'000          // full rate kept after the last motion
+#define ENC_MOTION_IDLE_INTERVAL_US 1'000'000 // encode interval on a static scene
+#define ENC_INPUT_QUEUE_SIZE_DEFAULT 4 // frames queued for the encode thread when queue_size is unset
+#define ENC_OVERFLOW_BLOCK 0           // execute waits for room, backpressure reaches upstream
+#define ENC_OVERFLOW_DROP_OLDEST 1     // the oldest queued frame is dropped
+#define ENC_OVERFLOW_DROP_NONREF 2     // the oldest queued frame that does not open a GOP is dropped, IDRs are
+                                       // then forced on the gop_size cadence even with a single rendition
+#define ENC_OVERFLOW_POLICY_DEFAULT ENC_OVERFLOW_BLOCK
+#define ENC_METRICS_INTERVAL_US 10'000'000 // encode latency and queue depth log interval
 
 using namespace aup::avaf;
 using namespace std;
 
+// one rung of the output ladder: rendition 0 encodes the configured size, every further one a copy scaled down from
+// the rung above it, with its VideoPacket on output 2 * idx and its AVCodecContextPacket on output 2 * idx + 1
+struct EncRendition
+{
+	uint32_t idx               = 0;
+	AVCodecContext* pVcodecCtx = NULL;
+	vector<AVFrame*> conv_frames; // encoder-format frames that non-native input is converted into
+	size_t next_conv_frame     = 0;
+	uint64_t conv_realloc_cnt  = 0; // conversions that found every conversion frame still referenced
+	SwsContext* pSwsCtx        = NULL;
+	AVPacket* pPacket          = NULL;
+	AVFrame* enc_frame         = NULL; // picture of the current input frame at this rung
+	PtsRing<ENC_PTS_RING_SIZE> pts_to_sts;
+	VideoPacketPool vpacket_pool{ENC_PACKET_POOL_SIZE};
+	timestamp_t last_retrieved_sts = 0;
+	uint32_t recv_vpacket_cnt      = 0;
+	thread encode_thread_id; // every rung but 0 encodes on its own thread
+
+	~EncRendition();
+};
+
+// one input frame waiting for the encode thread
+struct EncInput
+{
+	PacketPtr<const ImagePacket> vfrm;
+	PacketPtr<const DetectionPacket> detections;
+	bool gop_start        = false; // rendition IDRs are forced on this frame
+	timestamp_t queued_us = 0;
+};
+
 class X86EncCalculator : public CalculatorBase<VideoCodecOptions>
 {
 	bool need_i_img_stream_info_side_packet = false;
 	PacketPtr<VideoStreamInfoPacket> i_img_stream_info; // input image stream video information
 	PacketPtr<VideoStreamInfoPacket> o_vid_stream_info; // output packet stream video information
 	mutex m;
-	uint32_t send_img_packet_cnt = 0;
-	uint32_t recv_vpacket_cnt    = 0;
-	AVCodecContext* pVcodecCtx   = NULL;
-	AVFrame* pFrame   = NULL;
-	AVPacket* pPacket = NULL;
-	unordered_map<timestamp_t, timestamp_t> pts_to_sts;
-	timestamp_t last_retrieved_pts = timestamp_min;
+	atomic<uint32_t> send_img_packet_cnt{0};
+	int detections_input_idx = -1;
+	// execute -> encode thread
+	deque<EncInput> input_queue;
+	mutex input_m;
+	condition_variable input_ready;
+	condition_variable input_space;
+	size_t input_queue_size     = ENC_INPUT_QUEUE_SIZE_DEFAULT;
+	int overflow_policy         = ENC_OVERFLOW_POLICY_DEFAULT;
+	uint64_t queued_frame_cnt   = 0;
+	uint64_t overflow_drop_cnt  = 0;
+	bool aligned_idr            = false; // IDRs forced on the gop_size cadence, see set_encoder_threading_opts
+	bool idr_pending            = false; // a GOP opening frame was gated, the next encoded frame opens the GOP
+	bool input_closed           = false; // teardown, the encode thread drains the queue and flushes the encoders
+	thread encode_thread_id;
+	// encode metrics, logged every ENC_METRICS_INTERVAL_US
+	timestamp_t latency_sum_us  = 0;
+	timestamp_t latency_max_us  = 0;
+	uint32_t latency_cnt        = 0;
+	uint32_t queue_depth_max    = 0;
+	timestamp_t last_metrics_us = 0;
+	AVFrame* pFrame             = NULL;
+	// motion gate, turned on by the motion_gate=1 param: luma thumbnails of the current input and of the last
+	// encoded frame
+	bool motion_gate                  = false;
+	SwsContext* motion_sws_ctx        = NULL;
+	vector<uint8_t> motion_thumb      = vector<uint8_t>(ENC_MOTION_THUMB_W * ENC_MOTION_THUMB_H);
+	vector<uint8_t> motion_ref        = vector<uint8_t>(ENC_MOTION_THUMB_W * ENC_MOTION_THUMB_H);
+	timestamp_t last_enc_pts          = timestamp_min;
+	timestamp_t motion_hold_until_pts = timestamp_min;
+	uint64_t gated_frame_cnt          = 0;
+	vector<unique_ptr<EncRendition>> renditions;
+	// execute publishes each input frame to the rung threads and waits until every rung has sent it to its encoder,
+	// so the pyramid frames can be rebuilt for the next input
+	condition_variable frame_ready;
+	condition_variable frame_done;
+	uint64_t frame_seq          = 0;
+	uint32_t pending_renditions = 0;
+	timestamp_t frame_pts       = 0;
+	timestamp_t frame_sts       = 0;
+	bool running_               = false;
+	// encoder params from the enc name, see parse_enc_params; empty and -1 keep the encoder's own choice
+	string preset;
+	string tune;
+	int rc_lookahead   = -1;
+	int sliced_threads = -1;
+	vector<int> ladder_heights;
+	float roi_qoffset    = ENC_ROI_QOFFSET_DEFAULT;
+	float roi_bg_qoffset = ENC_ROI_BG_QOFFSET_DEFAULT;
+	bool parse_enc_params(string& err_str);
+	ErrorCode open_rendition(EncRendition& r, const AVCodec* pCodec, int w, int h, string& str_err);
+	void set_encoder_threading_opts(AVCodecContext* pVcodecCtx);
+	AVFrame* to_encoder_frame(EncRendition& r, AVFrame* src);
+	void encode_thread();
+	bool encode_input(EncInput& in);
+	void log_metrics();
+	bool motion_gate_pass(const AVFrame* input, timestamp_t pts, bool has_objects);
+	void attach_roi(AVFrame* enc_frame, const AVFrame* input, PacketPtr<const DetectionPacket>& detections);
+	void encode_frame(EncRendition& r, timestamp_t pts, timestamp_t sts);
+	void flush_encoder(EncRendition& r);
+	void receive_packets(EncRendition& r);
+	void rendition_thread(EncRendition* r);
 
 protected:
 	ErrorCode fill_contract(shared_ptr<Contract>& contract, string& err_str) override;